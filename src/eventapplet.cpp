@@ -68,6 +68,7 @@ K_EXPORT_PLASMA_APPLET(events, EventApplet)
 
 static const int MAX_RETRIES = 12;
 static const int WAIT_FOR_KO_MSECS = 2000;
+static const int STARTUP_TIMEOUT_MSECS = 60000;
 
 EventApplet::EventApplet(QObject *parent, const QVariantList &args) :
     Plasma::PopupApplet(parent, args),
@@ -84,7 +85,9 @@ EventApplet::EventApplet(QObject *parent, const QVariantList &args) :
     categoriesDialog(0),
     m_openEventWatcher(0),
     m_addEventWatcher(0),
-    m_addTodoWatcher(0)
+    m_addTodoWatcher(0),
+    m_startupWatchdog(0),
+    m_modelStarted(false)
 {
     KGlobal::locale()->insertCatalog("libkcal");
     setBackgroundHints(DefaultBackground);
@@ -164,36 +167,54 @@ void EventApplet::init()
 
     graphicsWidget();
 
+    m_startupTime.start();
     Plasma::ToolTipManager::self()->registerWidget(this);
     createToolTip();
 
     lastCheckTime = QDateTime::currentDateTime();
     m_timer = new QTimer();
     connect(m_timer, SIGNAL(timeout()), this, SLOT(timerExpired()));
-    QTimer::singleShot(1500, this, SLOT(slotStartServer()));
-    QTimer::singleShot(5000, this, SLOT(setupModel()));
-    setBusy(true);
+    setupModel();
+    startupPhase("snapshot shown");
+
+    connect(Akonadi::ServerManager::self(), SIGNAL(started()), this, SLOT(akonadiStatusChanged()));
+    if (Akonadi::ServerManager::isRunning()) {
+        startModel();
+    } else {
+        // the model starts when the server reports it is up, the watchdog only
+        // stops waiting for it
+        m_startupWatchdog = new QTimer(this);
+        m_startupWatchdog->setSingleShot(true);
+        connect(m_startupWatchdog, SIGNAL(timeout()), this, SLOT(startupTimeout()));
+        m_startupWatchdog->start(STARTUP_TIMEOUT_MSECS);
+
+        Akonadi::ServerManager::start();
+        startupPhase("server start requested");
+    }
 }
 
-void EventApplet::slotStartServer()
+void EventApplet::startupPhase(const char *phase)
 {
-    Akonadi::ServerManager::start();
+    if (!m_modelStarted)
+        kDebug() << "Startup:" << phase << "after" << m_startupTime.elapsed() << "ms";
 }
 
 void EventApplet::setupModel()
 {
-    setBusy(false);
 //     Akonadi::Control::widgetNeedsAkonadi(m_view);
 
     m_agentManager = Akonadi::AgentManager::self();
+    // resources that were offline during the initial fetch are fetched again,
+    // however the model was started
+    connect(m_agentManager, SIGNAL(instanceOnline(const Akonadi::AgentInstance &, bool)),
+            this, SLOT(agentOnline(const Akonadi::AgentInstance &, bool)));
 
     m_model = new EventModel(this, m_urgency, m_birthdayUrgency, m_colors, m_recurringCount, m_autoGroupHeader);
     m_model->setCategoryColors(m_categoryColors);
     m_model->setHeaderItems(m_headerItemsList);
-    if (Akonadi::ServerManager::isRunning()) {
-        m_model->initModel();
-        m_model->initMonitor();
-    }
+    m_model->setPeriod(m_period);
+    m_model->setExcludedCollections(disabledCollections);
+    m_model->loadSnapshot(); // show the last known events until akonadi is up
 
     m_filterModel = new EventFilterModel(this);
     m_filterModel->setPeriod(m_period);
@@ -206,7 +227,6 @@ void EventApplet::setupModel()
 
     m_view->setModel(m_filterModel);
     m_view->expandAll();
-    connect(m_model, SIGNAL(modelNeedsExpanding()), m_view, SLOT(expandAll()));
 
     QString koConfigPath = KStandardDirs::locateLocal("config", "korganizerrc");
     m_categoryColorWatch = new KDirWatch(this);
@@ -218,7 +238,37 @@ void EventApplet::setupModel()
 
     m_timer->start(2 * 60 * 1000);
 
-    connect(Akonadi::ServerManager::self(), SIGNAL(started()), this, SLOT(akonadiStatusChanged()));
+    setBusy(m_model->rowCount() == 0);
+}
+
+void EventApplet::startModel()
+{
+    if (m_startupWatchdog)
+        m_startupWatchdog->stop();
+    setBusy(false);
+
+    m_model->initModel();
+    m_model->initMonitor();
+    startupPhase("model started");
+    m_modelStarted = true;
+}
+
+void EventApplet::startupTimeout()
+{
+    startupPhase("server did not start");
+    setBusy(false);
+
+    // keep the snapshot if there is one, the model starts once the server is up
+    if (m_model->rowCount() == 0) {
+        m_model->resetModel();
+        m_modelStarted = true;
+    }
+}
+
+void EventApplet::agentOnline(const Akonadi::AgentInstance &instance, bool online)
+{
+    if (online)
+        m_model->resourceOnline(instance.identifier());
 }
 
 void EventApplet::setupCategoryColors(int opacity)
@@ -263,7 +313,7 @@ void EventApplet::plasmaThemeChanged()
     m_view->viewport()->setPalette(p);
     m_view->setPalette(p);
 
-    colorizeModel(false);
+    m_model->refreshColors();
 }
 
 void EventApplet::koConfigChanged()
@@ -272,12 +322,16 @@ void EventApplet::koConfigChanged()
     int opacity = cg.readEntry("KOOpacity", 10);
     setupCategoryColors(opacity);
     m_model->setCategoryColors(m_categoryColors);
-    colorizeModel(false);
 }
 
 void EventApplet::akonadiStatusChanged()
 {
-    m_model->resetModel();
+    startupPhase("server started");
+    if (m_modelStarted) {
+        m_model->resetModel();
+    } else {
+        startModel();
+    }
 }
 
 QGraphicsWidget *EventApplet::graphicsWidget()
@@ -452,20 +506,16 @@ void EventApplet::timedAddTodo()
 
 void EventApplet::slotDeleteEvent()
 {
-    const QVariant v = m_filterModel->data(m_indexAtCursor, Qt::DisplayRole);
-    QMap<QString, QVariant> values = v.toMap();
+    const IncidenceRecord record = m_filterModel->data(m_indexAtCursor, EventModel::RecordRole).value<IncidenceRecord>();
 
-    bool recurs = values["recurs"].toBool();
-    if (recurs) {
+    if (record.recurs) {
         KMessageBox::information(0, i18n("Deleting recurring incidences is not supported."), i18n("Not supported"));
         return;
     }
 
-    QString summary = values["summary"].toString();
-    if (KMessageBox::questionYesNo(0, i18n("Really delete \"%1\"?", summary), i18n("Delete Incidence")) == KMessageBox::Yes) {
+    if (KMessageBox::questionYesNo(0, i18n("Really delete \"%1\"?", record.summary), i18n("Delete Incidence")) == KMessageBox::Yes) {
         Akonadi::Item item;
-        qint64 id = m_filterModel->data(m_indexAtCursor, EventModel::ItemIDRole).toLongLong();
-        item.setId(id);
+        item.setId(record.itemId);
         new Akonadi::ItemDeleteJob(item);
     }
 }
@@ -473,9 +523,8 @@ void EventApplet::slotDeleteEvent()
 void EventApplet::timerExpired()
 {
     if (lastCheckTime.date() != QDate::currentDate()) {
-        m_model->resetModel();
-    } else {
-        colorizeModel(true);
+        m_model->dayChanged();
+        m_filterModel->dateChanged();
     }
 
     lastCheckTime = QDateTime::currentDateTime();
@@ -547,6 +596,7 @@ void EventApplet::collectionDialogAccepted()
     cg.writeEntry("DisabledCollections", disabledCollections);
     emit configNeedsSaving();
 
+    m_model->setExcludedCollections(disabledCollections);
     m_filterModel->setExcludedCollections(disabledCollections);
     m_view->expandAll();
 }
@@ -867,15 +917,12 @@ void EventApplet::configAccepted()
     m_delegate->settingsChanged(normalEventFormat, todoFormat, noDueDateFormat, dateFormat, customString);
 
     //color config
-    int oldUrgency = m_urgency;
     m_urgency = m_colorConfigUi.urgencyBox->value();
     cg.writeEntry("UrgencyTime", m_urgency);
     
-    int oldBirthdayUrgency = m_birthdayUrgency;
     m_birthdayUrgency = m_colorConfigUi.birthdayUrgencyBox->value();
     cg.writeEntry("BirthdayUrgencyTime", m_birthdayUrgency);
 
-    QList<QColor> oldColors = m_colors;
     m_colors.clear();
 
     m_urgentBg = m_colorConfigUi.urgentColorButton->color();
@@ -907,7 +954,6 @@ void EventApplet::configAccepted()
     m_finishedTodoBg.setAlphaF(finishedTodoOpacity/100.0);
     m_colors.insert(finishedTodoColorPos, m_finishedTodoBg);
 
-    QHash<QString, QColor> oldColorHash = m_categoryColors;
     int opacity = m_colorConfigUi.korganizerOpacity->value();
     cg.writeEntry("KOOpacity", opacity);
     setupCategoryColors(opacity);
@@ -917,6 +963,7 @@ void EventApplet::configAccepted()
     m_model->setHeaderItems(m_headerItemsList);
 
     if (oldPeriod != m_period) {
+        m_model->setPeriod(m_period);
         m_filterModel->setPeriod(m_period);
     }
 
@@ -926,9 +973,6 @@ void EventApplet::configAccepted()
 
     if (oldHeaderList != m_headerItemsList || oldRecurringCount != m_recurringCount || oldAutoGroup != m_autoGroupHeader) {
         m_model->resetModel();
-    } else if (oldUrgency != m_urgency || oldBirthdayUrgency != m_birthdayUrgency || oldColors != m_colors ||
-        oldColorHash != m_categoryColors) {
-        colorizeModel(false);
     }
 
     if (oldAppletTitle != m_appletTitle) {
@@ -944,62 +988,4 @@ void EventApplet::configAccepted()
     emit configNeedsSaving();
 }
 
-void EventApplet::colorizeModel(bool timerTriggered)
-{
-    QColor defaultTextColor = Plasma::Theme::defaultTheme()->color(Plasma::Theme::TextColor);
-    QDateTime now = QDateTime::currentDateTime();
-
-    int headerRows = m_model->rowCount(QModelIndex());
-    for (int r = 0; r < headerRows; ++r) {
-        QModelIndex headerIndex = m_model->index(r, 0, QModelIndex());
-        QDateTime headerDtTime = m_model->data(headerIndex, EventModel::SortRole).toDateTime();
-        m_model->setData(headerIndex, QVariant(QBrush(defaultTextColor)), Qt::ForegroundRole);
-        if (timerTriggered && now.daysTo(headerDtTime) > m_birthdayUrgency) {
-            break;
-        }
-        int childRows = m_model->rowCount(headerIndex);
-        for (int c = 0; c < childRows; ++c) {
-            QModelIndex index = m_model->index(c, 0, headerIndex);
-            const QVariant v = index.data(Qt::DisplayRole);
-            QMap<QString, QVariant> values = v.toMap();
-            QString category = values["mainCategory"].toString();
-            int itemRole = m_model->data(index, EventModel::ItemTypeRole).toInt();
-            QDateTime itemDtTime = m_model->data(index, EventModel::SortRole).toDateTime();
-
-            m_model->setData(index, QVariant(QBrush(defaultTextColor)), Qt::ForegroundRole);
-
-            if (timerTriggered && now.daysTo(itemDtTime) > m_birthdayUrgency) {
-                break;
-            } else if (itemRole == EventModel::BirthdayItem || itemRole == EventModel::AnniversaryItem) {
-                if (itemDtTime.date() >= now.date() && now.daysTo(itemDtTime) < m_birthdayUrgency) {
-                    m_model->setData(index, QVariant(QBrush(m_urgentBg)), Qt::BackgroundRole);
-                } else if (m_categoryColors.contains(category)) {
-                    m_model->setData(index, QVariant(QBrush(m_categoryColors.value(category))), Qt::BackgroundRole);
-                } else {
-                    m_model->setData(index, QVariant(QBrush(Qt::transparent)), Qt::BackgroundRole);
-                }
-            } else if (itemRole == EventModel::NormalItem) {
-                if (itemDtTime > now && now.secsTo(itemDtTime) < m_urgency * 60) {
-                    m_model->setData(index, QVariant(QBrush(m_urgentBg)), Qt::BackgroundRole);
-                } else if (now > itemDtTime) {
-                    m_model->setData(index, QVariant(QBrush(m_passedFg)), Qt::ForegroundRole);
-                    m_model->setData(index, QVariant(QBrush(Qt::transparent)), Qt::BackgroundRole);
-                } else if (m_categoryColors.contains(category)) {
-                    m_model->setData(index, QVariant(QBrush(m_categoryColors.value(category))), Qt::BackgroundRole);
-                } else {
-                    m_model->setData(index, QVariant(QBrush(Qt::transparent)), Qt::BackgroundRole);
-                }
-            } else if (itemRole == EventModel::TodoItem) {
-                if (values["completed"].toBool() == true) {
-                    m_model->setData(index, QVariant(QBrush(m_finishedTodoBg)), Qt::BackgroundRole);
-                } else if (m_categoryColors.contains(category)) {
-                    m_model->setData(index, QVariant(QBrush(m_categoryColors.value(category))), Qt::BackgroundRole);
-                } else {
-                    m_model->setData(index, QVariant(QBrush(m_todoBg)), Qt::BackgroundRole);
-                }
-            }
-        }
-    }
-}
-
 #include "eventapplet.moc"
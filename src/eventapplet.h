@@ -27,6 +27,7 @@
 
 // Qt headers
 #include <QHash>
+#include <QTime>
 #include <QGraphicsSceneHoverEvent>
 
 
@@ -81,6 +82,7 @@ private slots:
     void setShownCategories();
     void categoriesDialogAccepted();
     void setupModel();
+    void startModel();
     void akonadiStatusChanged();
     void plasmaThemeChanged();
     void koConfigChanged();
@@ -90,7 +92,8 @@ private slots:
     void timedOpenEvent();
     void timedAddEvent();
     void timedAddTodo();
-    void slotStartServer();
+    void startupTimeout();
+    void agentOnline(const Akonadi::AgentInstance &instance, bool online);
 
 protected slots:
     void configAccepted();
@@ -101,8 +104,8 @@ protected:
 
 private:
     void setupCategoryColors(int opacity);
-    void colorizeModel(bool timerTriggered);
     void createToolTip();
+    void startupPhase(const char *phase);
     
 private:
     QGraphicsWidget *m_graphicsWidget;
@@ -133,6 +136,9 @@ private:
     QString m_uid, m_appletTitle;
     QModelIndex m_indexAtCursor;
     QDBusServiceWatcher *m_openEventWatcher, *m_addEventWatcher, *m_addTodoWatcher;
+    QTimer *m_startupWatchdog;
+    QTime m_startupTime;
+    bool m_modelStarted;
 };
 
 #endif
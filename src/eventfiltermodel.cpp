@@ -16,179 +16,346 @@
  */
 
 #include "eventfiltermodel.h"
-#include "eventmodel.h"
 
-#include <QVariant>
 #include <QDate>
 
-EventFilterModel::EventFilterModel(QObject *parent) : QSortFilterProxyModel(parent)
+EventFilterModel::EventFilterModel(QObject *parent) : QSortFilterProxyModel(parent),
+    m_eventModel(0),
+    m_applyingSettings(false)
 {
-    m_period = 365;
-    m_excludedCollections = QStringList();
-    m_disabledCategories = QStringList();
+    m_settings.period = 365;
+    m_settings.today = QDate::currentDate().toJulianDay();
+    m_settings.showFinishedTodos = false;
+    m_settings.eventsDisabled = false;
+    m_settings.todosDisabled = false;
 }
 
 EventFilterModel::~EventFilterModel()
 {
 }
 
+void EventFilterModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    if (this->sourceModel()) {
+        disconnect(this->sourceModel(), SIGNAL(rowsInserted(const QModelIndex &, int, int)),
+                   this, SLOT(sourceRowsInserted(const QModelIndex &, int, int)));
+        disconnect(this->sourceModel(), SIGNAL(rowsAboutToBeRemoved(const QModelIndex &, int, int)),
+                   this, SLOT(sourceRowsAboutToBeRemoved(const QModelIndex &, int, int)));
+        disconnect(this->sourceModel(), SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &)),
+                   this, SLOT(sourceDataChanged(const QModelIndex &, const QModelIndex &)));
+        disconnect(this->sourceModel(), SIGNAL(modelReset()), this, SLOT(sourceReset()));
+        disconnect(this->sourceModel(), SIGNAL(rowsInserted(const QModelIndex &, int, int)),
+                   this, SLOT(sourceRowsChanged()));
+        disconnect(this->sourceModel(), SIGNAL(rowsRemoved(const QModelIndex &, int, int)),
+                   this, SLOT(sourceRowsChanged()));
+        disconnect(this->sourceModel(), SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &)),
+                   this, SLOT(sourceRowsChanged()));
+    }
+
+    m_eventModel = qobject_cast<EventModel *>(sourceModel);
+    m_visibleChildren.clear();
+    m_acceptedSlots.clear();
+    m_crossedHeaders.clear();
+    updateMasks(&m_settings);
+
+    // connected before the proxy itself, so the counts are up to date when it
+    // filters the header again
+    connect(sourceModel, SIGNAL(rowsInserted(const QModelIndex &, int, int)),
+            this, SLOT(sourceRowsInserted(const QModelIndex &, int, int)));
+    connect(sourceModel, SIGNAL(rowsAboutToBeRemoved(const QModelIndex &, int, int)),
+            this, SLOT(sourceRowsAboutToBeRemoved(const QModelIndex &, int, int)));
+    connect(sourceModel, SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &)),
+            this, SLOT(sourceDataChanged(const QModelIndex &, const QModelIndex &)));
+    connect(sourceModel, SIGNAL(modelReset()), this, SLOT(sourceReset()));
+
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+
+    // and after it, for the headers whose children all came or went
+    connect(sourceModel, SIGNAL(rowsInserted(const QModelIndex &, int, int)),
+            this, SLOT(sourceRowsChanged()));
+    connect(sourceModel, SIGNAL(rowsRemoved(const QModelIndex &, int, int)),
+            this, SLOT(sourceRowsChanged()));
+    connect(sourceModel, SIGNAL(dataChanged(const QModelIndex &, const QModelIndex &)),
+            this, SLOT(sourceRowsChanged()));
+}
+
 void EventFilterModel::setPeriod(int period)
 {
-    m_period = period;
-    invalidateFilter();
+    Settings settings = m_settings;
+    settings.period = period;
+    applySettings(settings);
 }
 
 void EventFilterModel::setShowFinishedTodos(bool showFinishedTodos)
 {
-    m_showFinishedTodos = showFinishedTodos;
-    invalidateFilter();
+    Settings settings = m_settings;
+    settings.showFinishedTodos = showFinishedTodos;
+    applySettings(settings);
 }
 
 void EventFilterModel::setDisabledTypes(QStringList types)
 {
-    m_disabledTypes = types;
-    m_disabledTypes.sort();
-    invalidateFilter();
+    Settings settings = m_settings;
+    settings.eventsDisabled = types.contains("events");
+    settings.todosDisabled = types.contains("todos");
+    applySettings(settings);
 }
 
 void EventFilterModel::setExcludedCollections(QStringList collections)
 {
     m_excludedCollections = collections;
-    m_excludedCollections.sort();
-    invalidateFilter();
+    Settings settings = m_settings;
+    updateMasks(&settings);
+    applySettings(settings);
 }
 
 void EventFilterModel::setDisabledCategories(QStringList categories)
 {
     m_disabledCategories = categories;
-    m_disabledCategories.sort();
+    Settings settings = m_settings;
+    updateMasks(&settings);
+    applySettings(settings);
+}
+
+void EventFilterModel::dateChanged()
+{
+    refilter();
+}
+
+void EventFilterModel::refilter()
+{
+    // today is taken once for the whole pass, not for every row
+    m_settings.today = QDate::currentDate().toJulianDay();
+    m_visibleChildren.clear();
     invalidateFilter();
 }
 
-bool EventFilterModel::isDisabledType(QModelIndex idx) const
+void EventFilterModel::applySettings(const Settings &settings)
 {
-    bool isDisabled = false;
-    const int type = idx.data(EventModel::ItemTypeRole).toInt();
-    if (type == EventModel::NormalItem || type == EventModel::BirthdayItem || type == EventModel::AnniversaryItem) {
-        if (m_disabledTypes.contains("events"))
-            isDisabled = true;
-    } else if (type == EventModel::TodoItem) {
-        if (m_disabledTypes.contains("todos"))
-            isDisabled = true;
+    const Settings old = m_settings;
+    m_settings = settings;
+
+    if (!m_eventModel)
+        return;
+
+    if (old.today != QDate::currentDate().toJulianDay()) {
+        refilter();
+        return;
+    }
+
+    // only the rows whose outcome differs between the old and the new settings
+    // are filtered again, by telling the proxy that they changed
+    m_applyingSettings = true;
+    const int headerRows = sourceModel()->rowCount();
+    for (int r = 0; r < headerRows; ++r) {
+        const QModelIndex headerIdx = sourceModel()->index(r, 0);
+        const EventModel::FilterKey headerKey = m_eventModel->filterKey(headerIdx);
+        if (headerKey.day == 0)
+            continue;
+
+        int oldCount = 0, newCount = 0;
+        QList<QPair<int, int> > changedRanges;
+        const int rows = sourceModel()->rowCount(headerIdx);
+        for (int row = 0; row < rows; ++row) {
+            const EventModel::FilterKey key = m_eventModel->filterKey(sourceModel()->index(row, 0, headerIdx));
+            // the header is counted by its date, the row is filtered by its own
+            // day like in filterAcceptsRow()
+            const bool wasCounted = acceptsOccurrence(old, key, headerKey.day);
+            const bool counted = acceptsOccurrence(m_settings, key, headerKey.day);
+            oldCount += wasCounted;
+            newCount += counted;
+            setSlotAccepted(key.slot, counted);
+            if (acceptsOccurrence(old, key, key.day) != acceptsOccurrence(m_settings, key, key.day)) {
+                if (!changedRanges.isEmpty() && changedRanges.last().second == row - 1) {
+                    changedRanges.last().second = row;
+                } else {
+                    changedRanges.append(qMakePair(row, row));
+                }
+            }
+        }
+        m_visibleChildren.insert(headerKey.header, newCount);
+
+        if ((oldCount > 0) != (newCount > 0)) { // the header comes or goes with its children
+            m_eventModel->rowsChanged(QModelIndex(), r, r);
+        } else if (newCount > 0) {
+            for (int i = 0; i < changedRanges.count(); ++i) {
+                m_eventModel->rowsChanged(headerIdx, changedRanges.at(i).first, changedRanges.at(i).second);
+            }
+        }
     }
+    m_applyingSettings = false;
+}
+
+void EventFilterModel::updateMasks(Settings *settings)
+{
+    // the names are interned by the source model, they may be set before it
+    if (!m_eventModel)
+        return;
 
-    return isDisabled;
+    settings->excludedCollections = m_eventModel->collectionMask(m_excludedCollections);
+    settings->disabledCategories = m_eventModel->categoryMask(m_disabledCategories);
 }
 
-bool EventFilterModel::isDisabledCategory(QModelIndex idx) const
+bool EventFilterModel::acceptsOccurrence(const Settings &settings, const EventModel::FilterKey &key, int groupDay) const
 {
-    const QMap<QString, QVariant> values = idx.data(Qt::DisplayRole).toMap();
-    QStringList itemCategories = values["categories"].toStringList();
-    QStringList allCategories = m_disabledCategories + itemCategories;
+    const bool disabledType = key.type == EventModel::TodoItem ? settings.todosDisabled : settings.eventsDisabled;
 
-    bool allItemCategoriesDisabled = allCategories.removeDuplicates() == itemCategories.count();
-    return allItemCategoriesDisabled;
+    // hidden if all of its categories are disabled
+    if (disabledType || settings.excludedCollections.test(key.collectionIndex) || key.categories->isSubsetOf(settings.disabledCategories))
+        return false;
+
+    const int today = settings.today;
+    if (groupDay > today + 365) { // todos with no specified due date
+        return settings.showFinishedTodos || !key.completed;
+    } else if (groupDay > today + settings.period) { // stuff later than ...
+        return false;
+    } else if (groupDay < today) { // older stuff, dont show old finished stuff
+        if (key.type == EventModel::TodoItem)
+            return !key.completed;
+        return key.endDay >= today;
+    } else if (key.day > today + settings.period) { // stuff from today to period
+        return false;
+    } else if (key.type == EventModel::TodoItem) {
+        return settings.showFinishedTodos || !key.completed;
+    }
+
+    return true;
 }
 
 bool EventFilterModel::filterAcceptsRow( int sourceRow, const QModelIndex &sourceParent ) const
 {
     const QModelIndex idx = sourceModel()->index( sourceRow, 0, sourceParent );
+    const EventModel::FilterKey key = m_eventModel->filterKey(idx);
 
-    const int itemType = idx.data(EventModel::ItemTypeRole).toInt();
-    const QString collectionRole = idx.data(EventModel::CollectionRole).toString();
-
-    const QVariant d = idx.data(EventModel::SortRole);
-    const QDate date= d.toDate();
-
-    if (date.isValid()) {
-        if (date > QDate::currentDate().addDays(365)) { // todos with no specified due date
-            if (itemType == EventModel::HeaderItem) {
-                int rows = sourceModel()->rowCount(idx);
-                for (int row = 0; row < rows; ++ row) { // if the header would be empty dont show it
-                    QModelIndex childIdx = sourceModel()->index(row, 0, idx);
-                    const QString cr = childIdx.data(EventModel::CollectionRole).toString();
-                    if (!m_excludedCollections.contains(cr) && !isDisabledType(childIdx) && !isDisabledCategory(childIdx)) {
-                        const QMap<QString, QVariant> values = childIdx.data(Qt::DisplayRole).toMap();
-                        if (m_showFinishedTodos || values["completed"].toBool() == false)
-                            return true;
-                    }
-                }
-                return false;
-            } else {
-                if (!m_excludedCollections.contains(collectionRole) && !isDisabledType(idx) && !isDisabledCategory(idx)) {
-                    const QMap<QString, QVariant> values = idx.data(Qt::DisplayRole).toMap();
-                    if (m_showFinishedTodos || values["completed"].toBool() == false) {
-                        return true;
-                    }
-                }
-                return false;
-            }
-        } else if (date > QDate::currentDate().addDays(m_period)) { // stuff later than ...
-            return false;
-        } else if (date < QDate::currentDate()) { // older stuff
-            if (itemType == EventModel::HeaderItem) { // dont show empty header
-                if (sourceModel()->hasChildren(idx)) {
-                    int rows = sourceModel()->rowCount(idx);
-                    for (int row = 0; row < rows; ++row) {
-                        QModelIndex childIdx = sourceModel()->index(row, 0, idx);
-                        const QString cr = childIdx.data(EventModel::CollectionRole).toString();
-                        if (!m_excludedCollections.contains(cr) && !isDisabledType(childIdx) && !isDisabledCategory(childIdx)) {
-                            const int childType = childIdx.data(EventModel::ItemTypeRole).toInt();
-                            const QMap<QString, QVariant> values = childIdx.data(Qt::DisplayRole).toMap();
-                            if (childType == EventModel::TodoItem) { // dont show old finished stuff
-                                if (values["completed"].toBool() == false)
-                                    return true;
-                            } else {
-                                if (values["endDate"].toDate() >= QDate::currentDate())
-                                    return true;
-                            }
-                        }
-                    }
-                }
-                return false;
-            } else {
-                if (m_excludedCollections.contains(collectionRole) || isDisabledType(idx) || isDisabledCategory(idx)) {
-                    return false;
-                }
-                
-                const QMap<QString, QVariant> values = idx.data(Qt::DisplayRole).toMap();
-                if (itemType == EventModel::TodoItem) {
-                    if (values["completed"].toBool() == true) {
-                        return false;
-                    }
-                } else if (values["endDate"].toDate() < QDate::currentDate()) {
-                    return false;
-                }
-            }
-        } else { // stuff from today to period
-            if (itemType == EventModel::HeaderItem) { // dont show empty header
-                int rows = sourceModel()->rowCount(idx);
-                for (int row = 0; row < rows; ++ row) {
-                    QModelIndex childIdx = sourceModel()->index(row, 0, idx);
-                    const QString cr = childIdx.data(EventModel::CollectionRole).toString();
-                    const QDate cd = childIdx.data(EventModel::SortRole).toDate();
-                    if ((!m_excludedCollections.contains(cr) && !isDisabledType(childIdx) && !isDisabledCategory(childIdx)) && cd <= QDate::currentDate().addDays(m_period)) {
-                        const int childType = childIdx.data(EventModel::ItemTypeRole).toInt();
-                        const QMap<QString, QVariant> values = childIdx.data(Qt::DisplayRole).toMap();
-                        if (childType != EventModel::TodoItem) {
-                            return true;
-                        } else if (m_showFinishedTodos || values["completed"].toBool() == false) {
-                            return true;
-                        }
-                    }
-                }
-                return false;
-            } else if (m_excludedCollections.contains(collectionRole) || isDisabledType(idx) || isDisabledCategory(idx)) {
-                return false;
-            } else if (itemType == EventModel::TodoItem) {
-                const QMap<QString, QVariant> values = idx.data(Qt::DisplayRole).toMap();
-                if (!m_showFinishedTodos && values["completed"].toBool() == true)
-                    return false;
-            }
-        }
-    } else { // no valid date
+    if (key.day == 0) // no valid date
         return false;
+
+    if (key.type != EventModel::HeaderItem)
+        return acceptsOccurrence(m_settings, key, key.day);
+
+    // dont show empty headers
+    return visibleChildCount(idx, key) > 0;
+}
+
+int EventFilterModel::visibleChildCount(const QModelIndex &header, const EventModel::FilterKey &key) const
+{
+    QHash<const void *, int>::const_iterator it = m_visibleChildren.constFind(key.header);
+    if (it != m_visibleChildren.constEnd())
+        return it.value();
+
+    const int count = countVisibleChildren(header, key.day, 0, sourceModel()->rowCount(header) - 1);
+    m_visibleChildren.insert(key.header, count);
+    return count;
+}
+
+int EventFilterModel::countVisibleChildren(const QModelIndex &header, int groupDay, int first, int last) const
+{
+    // the children are judged by the date of the header, the outcome is kept
+    // so that later changes only need the difference
+    int count = 0;
+    for (int row = first; row <= last; ++row) {
+        const EventModel::FilterKey key = m_eventModel->filterKey(sourceModel()->index(row, 0, header));
+        const bool accepted = acceptsOccurrence(m_settings, key, groupDay);
+        setSlotAccepted(key.slot, accepted);
+        count += accepted;
     }
 
-    return true;
+    return count;
+}
+
+int EventFilterModel::countAcceptedSlots(const QModelIndex &header, int first, int last) const
+{
+    int count = 0;
+    for (int row = first; row <= last; ++row) {
+        const int slot = m_eventModel->filterKey(sourceModel()->index(row, 0, header)).slot;
+        if (slot < m_acceptedSlots.size() && m_acceptedSlots.testBit(slot))
+            ++count;
+    }
+
+    return count;
+}
+
+void EventFilterModel::setSlotAccepted(int slot, bool accepted) const
+{
+    if (slot >= m_acceptedSlots.size()) {
+        if (!accepted)
+            return;
+        m_acceptedSlots.resize(qMax(slot + 1, 2 * m_acceptedSlots.size()));
+    }
+    m_acceptedSlots.setBit(slot, accepted);
+}
+
+void EventFilterModel::sourceRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    if (!parent.isValid()) // new headers are counted when they are filtered
+        return;
+
+    const EventModel::FilterKey key = m_eventModel->filterKey(parent);
+    QHash<const void *, int>::iterator it = m_visibleChildren.find(key.header);
+    if (it == m_visibleChildren.end())
+        return;
+
+    const int oldCount = it.value();
+    it.value() += countVisibleChildren(parent, key.day, first, last);
+    if (oldCount == 0 && it.value() > 0)
+        m_crossedHeaders.append(parent.row());
+}
+
+void EventFilterModel::sourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (!parent.isValid()) {
+        for (int row = first; row <= last; ++row) {
+            m_visibleChildren.remove(m_eventModel->filterKey(sourceModel()->index(row, 0)).header);
+        }
+        return;
+    }
+
+    const EventModel::FilterKey key = m_eventModel->filterKey(parent);
+    QHash<const void *, int>::iterator it = m_visibleChildren.find(key.header);
+    if (it == m_visibleChildren.end())
+        return;
+
+    const int oldCount = it.value();
+    it.value() -= countAcceptedSlots(parent, first, last);
+    if (oldCount > 0 && it.value() == 0)
+        m_crossedHeaders.append(parent.row());
+}
+
+void EventFilterModel::sourceRowsChanged()
+{
+    // runs after the proxy has handled the change, so the headers can be
+    // filtered again without confusing its mapping
+    const QList<int> rows = m_crossedHeaders;
+    m_crossedHeaders.clear();
+    foreach (int row, rows) {
+        m_eventModel->rowsChanged(QModelIndex(), row, row);
+    }
+}
+
+void EventFilterModel::sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    // changed headers keep their children, their dates only move with dateChanged()
+    const QModelIndex parent = topLeft.parent();
+    if (m_applyingSettings || !parent.isValid())
+        return;
+
+    // uncounted headers are counted when they are filtered
+    const EventModel::FilterKey key = m_eventModel->filterKey(parent);
+    QHash<const void *, int>::iterator it = m_visibleChildren.find(key.header);
+    if (it == m_visibleChildren.end())
+        return;
+
+    // only the changed rows are judged again, against their last outcome
+    const int oldCount = it.value();
+    it.value() -= countAcceptedSlots(parent, topLeft.row(), bottomRight.row());
+    it.value() += countVisibleChildren(parent, key.day, topLeft.row(), bottomRight.row());
+    if ((oldCount > 0) != (it.value() > 0))
+        m_crossedHeaders.append(parent.row());
+}
+
+void EventFilterModel::sourceReset()
+{
+    m_visibleChildren.clear();
+    m_acceptedSlots.clear();
+    m_crossedHeaders.clear();
 }
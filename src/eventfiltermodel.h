@@ -18,6 +18,11 @@
 #ifndef EVENTFILTERMODEL_H
 #define EVENTFILTERMODEL_H
 
+#include "eventmodel.h"
+
+#include <QBitArray>
+#include <QHash>
+#include <QList>
 #include <QSortFilterProxyModel>
 #include <QStringList>
 
@@ -29,23 +34,49 @@ public:
     explicit EventFilterModel(QObject *parent = 0);
     ~EventFilterModel();
     
+    void setSourceModel(QAbstractItemModel *sourceModel);
     void setPeriod(int period);
     void setShowFinishedTodos(bool showFinishedTodos);
     void setDisabledTypes(QStringList types);
     void setExcludedCollections(QStringList collections);
     void setDisabledCategories(QStringList categories);
+    void dateChanged();
     
 protected:
     bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const;
 
+private slots:
+    void sourceRowsInserted(const QModelIndex &parent, int first, int last);
+    void sourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    void sourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void sourceRowsChanged();
+    void sourceReset();
+
 private:
-    bool isDisabledType(QModelIndex idx) const;
-    bool isDisabledCategory(QModelIndex idx) const;
+    struct Settings {
+        int period;
+        int today;
+        bool showFinishedTodos, eventsDisabled, todosDisabled;
+        FilterMask excludedCollections, disabledCategories;
+    };
+
+    void refilter();
+    void applySettings(const Settings &settings);
+    void updateMasks(Settings *settings);
+    bool acceptsOccurrence(const Settings &settings, const EventModel::FilterKey &key, int groupDay) const;
+    int visibleChildCount(const QModelIndex &header, const EventModel::FilterKey &key) const;
+    int countVisibleChildren(const QModelIndex &header, int groupDay, int first, int last) const;
+    int countAcceptedSlots(const QModelIndex &header, int first, int last) const;
+    void setSlotAccepted(int slot, bool accepted) const;
 
 private:
-    int m_period;
-    bool m_showFinishedTodos;
-    QStringList m_disabledTypes, m_excludedCollections, m_disabledCategories;
+    EventModel *m_eventModel;
+    Settings m_settings;
+    QStringList m_excludedCollections, m_disabledCategories;
+    mutable QHash<const void *, int> m_visibleChildren;
+    mutable QBitArray m_acceptedSlots;
+    QList<int> m_crossedHeaders;
+    bool m_applyingSettings;
 };
 
 #endif
@@ -45,27 +45,28 @@ EventItemDelegate::~EventItemDelegate()
 QString EventItemDelegate::displayText(const QVariant &value, const QLocale &locale) const
 {
     Q_UNUSED(locale);
-    QMap<QString, QVariant> data = value.toMap();
-    QString mainCategory = data["mainCategory"].toString();
-
-    int itemType = data["itemType"].toInt();
-    switch (itemType) {
-        case EventModel::HeaderItem:
+    if (value.userType() != qMetaTypeId<IncidenceRecord>()) { // header
+        QMap<QString, QVariant> data = value.toMap();
+        if (data["itemType"].toInt() == EventModel::HeaderItem)
             return  KMacroExpander::expandMacros(data["title"].toString(), titleHash(data));
-            break;
+        return QString();
+    }
+
+    const IncidenceRecord record = value.value<IncidenceRecord>();
+    switch (record.itemType) {
         case EventModel::NormalItem:
         case EventModel::BirthdayItem:
         case EventModel::AnniversaryItem:
-            if (m_categoryFormats.contains(mainCategory))
-                return KMacroExpander::expandMacros(m_categoryFormats.value(mainCategory), eventHash(data));
+            if (m_categoryFormats.contains(record.mainCategory))
+                return KMacroExpander::expandMacros(m_categoryFormats.value(record.mainCategory), eventHash(record));
             else
-                return KMacroExpander::expandMacros(m_normal, eventHash(data));
+                return KMacroExpander::expandMacros(m_normal, eventHash(record));
             break;
         case EventModel::TodoItem:
-            if (data["hasDueDate"].toBool() == false)
-                return KMacroExpander::expandMacros(m_noDueDate, todoHash(data));
+            if (record.hasDueDate == false)
+                return KMacroExpander::expandMacros(m_noDueDate, todoHash(record));
             else
-                return KMacroExpander::expandMacros(m_todo, todoHash(data));
+                return KMacroExpander::expandMacros(m_todo, todoHash(record));
             break;
         default:
             break;
@@ -122,49 +123,56 @@ QSize EventItemDelegate::sizeHint(const QStyleOptionViewItem &option, const QMod
 QHash<QString, QString> EventItemDelegate::titleHash(QMap<QString, QVariant> data) const
 {
     QHash<QString,QString> dataHash;
-    dataHash.insert("date", formattedDate(data["date"]));
+    dataHash.insert("date", formattedDate(data["date"].toDateTime()));
     dataHash.insert("weekday", data["date"].toDateTime().toString("dddd"));
 
     return dataHash;
 }
 
-QHash<QString, QString> EventItemDelegate::eventHash(QMap<QString, QVariant> data) const
+QHash<QString, QString> EventItemDelegate::eventHash(const IncidenceRecord &record) const
 {
     QHash<QString,QString> dataHash;
     ulong s;
-    dataHash.insert("startDate", formattedDate(data["startDate"]));
-    dataHash.insert("endDate", formattedDate(data["endDate"]));
-    dataHash.insert("startTime", KGlobal::locale()->formatTime(data["startDate"].toTime()));
-    dataHash.insert("endTime", KGlobal::locale()->formatTime(data["endDate"].toTime()));
-    s = data["startDate"].toDateTime().secsTo(data["endDate"].toDateTime());
+    dataHash.insert("startDate", formattedDate(record.startDate));
+    dataHash.insert("endDate", formattedDate(record.endDate));
+    dataHash.insert("startTime", KGlobal::locale()->formatTime(record.startDate.time()));
+    dataHash.insert("endTime", KGlobal::locale()->formatTime(record.endDate.time()));
+    s = record.startDate.secsTo(record.endDate);
     dataHash.insert("duration", KGlobal::locale()->prettyFormatDuration(s * 1000));
-    dataHash.insert("summary", data["summary"].toString());
-    dataHash.insert("description", data["description"].toString());
-    dataHash.insert("location", data["location"].toString());
-    dataHash.insert("yearsSince", data["yearsSince"].toString());
-    dataHash.insert("collectionName", data["collectionName"].toString());
-    dataHash.insert("mainCategory", data["mainCategory"].toString());
-    dataHash.insert("categories", data["categories"].toStringList().join(", "));
-    dataHash.insert("contactName", data["contactName"].toString());
+    dataHash.insert("summary", record.summary);
+    dataHash.insert("description", record.description);
+    dataHash.insert("location", record.location);
+    if (record.itemType == EventModel::BirthdayItem) {
+        // workaround missing facebook birthdays
+        dataHash.insert("yearsSince", record.yearsSince > 2000 ? QString("XX") : QString::number(record.yearsSince));
+    } else if (record.itemType == EventModel::AnniversaryItem) {
+        dataHash.insert("yearsSince", QString::number(record.yearsSince));
+    } else {
+        dataHash.insert("yearsSince", QString());
+    }
+    dataHash.insert("collectionName", record.collectionName);
+    dataHash.insert("mainCategory", record.mainCategory);
+    dataHash.insert("categories", record.categories.join(", "));
+    dataHash.insert("contactName", record.contactName);
     dataHash.insert("tab", "\t");
 
     return dataHash;
 }
 
-QHash<QString, QString> EventItemDelegate::todoHash(QMap<QString, QVariant> data) const
+QHash<QString, QString> EventItemDelegate::todoHash(const IncidenceRecord &record) const
 {
     QHash<QString,QString> dataHash;
-    dataHash.insert("startDate", formattedDate(data["startDate"]));
-    dataHash.insert("startTime", KGlobal::locale()->formatTime(data["startDate"].toTime()));
-    dataHash.insert("dueDate", formattedDate(data["dueDate"]));
-    dataHash.insert("dueTime", KGlobal::locale()->formatTime(data["dueDate"].toTime()));
-    dataHash.insert("summary", data["summary"].toString());
-    dataHash.insert("description", data["description"].toString());
-    dataHash.insert("location", data["location"].toString());
-    dataHash.insert("collectionName", data["collectionName"].toString());
-    dataHash.insert("mainCategory", data["mainCategory"].toString());
-    dataHash.insert("categories", data["categories"].toStringList().join(", "));
-    dataHash.insert("percent", QString::number(data["percent"].toInt()));
+    dataHash.insert("startDate", formattedDate(record.startDate));
+    dataHash.insert("startTime", KGlobal::locale()->formatTime(record.startDate.time()));
+    dataHash.insert("dueDate", formattedDate(record.dueDate));
+    dataHash.insert("dueTime", KGlobal::locale()->formatTime(record.dueDate.time()));
+    dataHash.insert("summary", record.summary);
+    dataHash.insert("description", record.description);
+    dataHash.insert("location", record.location);
+    dataHash.insert("collectionName", record.collectionName);
+    dataHash.insert("mainCategory", record.mainCategory);
+    dataHash.insert("categories", record.categories.join(", "));
+    dataHash.insert("percent", QString::number(record.percent));
     dataHash.insert("tab", "\t");
 
     return dataHash;
@@ -175,25 +183,25 @@ void EventItemDelegate::setCategoryFormats(QMap<QString, QString> formats)
 	m_categoryFormats = formats;
 }
 
-QString EventItemDelegate::formattedDate(const QVariant &dtTime) const
+QString EventItemDelegate::formattedDate(const QDateTime &dtTime) const
 {
     QString date;
-    if (dtTime.toDateTime().isValid()) {
+    if (dtTime.isValid()) {
         switch (m_dateFormat) {
             case ShortDateFormat:
-                date = KGlobal::locale()->formatDate(dtTime.toDate(), KLocale::ShortDate);
+                date = KGlobal::locale()->formatDate(dtTime.date(), KLocale::ShortDate);
                 break;
             case LongDateFormat:
-                date = KGlobal::locale()->formatDate(dtTime.toDate(), KLocale::LongDate);
+                date = KGlobal::locale()->formatDate(dtTime.date(), KLocale::LongDate);
                 break;
             case FancyShortDateFormat:
-                date = KGlobal::locale()->formatDate(dtTime.toDate(), KLocale::FancyShortDate);
+                date = KGlobal::locale()->formatDate(dtTime.date(), KLocale::FancyShortDate);
                 break;
             case FancyLongDateFormat:
-                date = KGlobal::locale()->formatDate(dtTime.toDate(), KLocale::FancyLongDate);
+                date = KGlobal::locale()->formatDate(dtTime.date(), KLocale::FancyLongDate);
                 break;
             case CustomDateFormat:
-                date = dtTime.toDate().toString(m_dateString);
+                date = dtTime.date().toString(m_dateString);
                 break;
         }
     }
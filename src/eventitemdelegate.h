@@ -18,6 +18,8 @@
 #ifndef EVENTITEMDELEGATE_H
 #define EVENTITEMDELEGATE_H
 
+#include "incidencerecord.h"
+
 #include <QStyledItemDelegate>
 
 class EventItemDelegate : public QStyledItemDelegate
@@ -36,10 +38,10 @@ public:
 
 private:
     QHash<QString, QString> titleHash(QMap<QString, QVariant>) const;
-    QHash<QString, QString> eventHash(QMap<QString, QVariant>) const;
-    QHash<QString, QString> todoHash(QMap<QString, QVariant>) const;
+    QHash<QString, QString> eventHash(const IncidenceRecord &record) const;
+    QHash<QString, QString> todoHash(const IncidenceRecord &record) const;
     QMap<QString, QString> m_categoryFormats;
-    QString formattedDate(const QVariant &dtTime) const;
+    QString formattedDate(const QDateTime &dtTime) const;
 
     QString m_normal, m_todo, m_noDueDate, m_dateString;
     int m_dateFormat;
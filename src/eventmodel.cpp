@@ -19,7 +19,6 @@
 #include "eventmodel.h"
 
 // kdepim headers
-#include <kcalcore/recurrence.h>
 #include <kcalutils/incidenceformatter.h>
 
 #include <akonadi/collectionfetchjob.h>
@@ -31,8 +30,14 @@
 #include <akonadi/servermanager.h>
 
 // qt headers
+#include <QBrush>
 #include <QDate>
-#include <QStandardItem>
+#include <QSet>
+#include <QTimer>
+#include <QtConcurrentMap>
+#include <QtAlgorithms>
+
+#include <algorithm>
 
 // kde headers
 #include <KIcon>
@@ -45,23 +50,339 @@
 
 #include <KDebug>
 
-EventModel::EventModel(QObject *parent, int urgencyTime, int birthdayTime, QList<QColor> colorList, int count, bool autoGroupHeader) : QStandardItemModel(parent),
-    parentItem(0),
-    m_monitor(0)
+// range of the day to header lookup table, relative to today
+static const int HeaderTableFirstDay = -28;
+static const int HeaderTableLastDay = 366;
+
+// characters of tooltip html kept for hovered items
+static const int TooltipCacheSize = 256 * 1024;
+
+// msecs to wait after a change before the snapshot is written
+static const int SnapshotDelay = 2000;
+
+// item fetch jobs running at the same time
+static const int MaxConcurrentFetches = 3;
+
+// longest msecs the transition timer sleeps, it catches up with clock changes
+static const int MaxTransitionDelay = 60 * 60 * 1000;
+
+namespace {
+    class OccurrenceLessThan
+    {
+    public:
+        OccurrenceLessThan(const OccurrenceTable &table) : m_table(table) {}
+        bool operator()(int a, int b) const
+        {
+            return m_table.sortKey(a) < m_table.sortKey(b);
+        }
+
+    private:
+        const OccurrenceTable &m_table;
+    };
+
+    class CollectionPriorityGreaterThan
+    {
+    public:
+        CollectionPriorityGreaterThan(const QHash<Akonadi::Entity::Id, int> &priority) : m_priority(priority) {}
+        bool operator()(const Akonadi::Collection &a, const Akonadi::Collection &b) const
+        {
+            return m_priority.value(a.id()) > m_priority.value(b.id());
+        }
+
+    private:
+        const QHash<Akonadi::Entity::Id, int> &m_priority;
+    };
+}
+
+EventModel::EventModel(QObject *parent, int urgencyTime, int birthdayTime, QList<QColor> colorList, int count, bool autoGroupHeader) : QAbstractItemModel(parent),
+    m_tooltips(TooltipCacheSize),
+    m_pendingFetches(0),
+    m_fetching(false),
+    m_monitor(0),
+    m_collectionMonitor(0),
+    m_period(365),
+    m_bulkInsert(false)
 {
-    parentItem = invisibleRootItem();
+    qRegisterMetaType<IncidenceRecord>("IncidenceRecord");
+
+    m_transitionTimer = new QTimer(this);
+    m_transitionTimer->setSingleShot(true);
+    connect(m_transitionTimer, SIGNAL(timeout()), this, SLOT(transitionsDue()));
+
     settingsChanged(urgencyTime, birthdayTime, colorList, count, autoGroupHeader);
+    m_recurrenceCache.load();
+
+    m_snapshotTimer = new QTimer(this);
+    m_snapshotTimer->setSingleShot(true);
+    m_snapshotTimer->setInterval(SnapshotDelay);
+    connect(m_snapshotTimer, SIGNAL(timeout()), this, SLOT(saveSnapshot()));
 //     initModel();
 //     initMonitor();
 }
 
 EventModel::~EventModel()
 {
+    cancelDecoding();
+    m_recurrenceCache.save();
+    if (m_snapshotTimer->isActive())
+        saveSnapshot();
+
+    QSet<HeaderItemData *> headers = m_sectionItemsMap.values().toSet() + m_headers.toSet();
+    qDeleteAll(headers);
+}
+
+QModelIndex EventModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (row < 0 || column != 0)
+        return QModelIndex();
+
+    if (!parent.isValid()) {
+        if (row < m_headers.count())
+            return createIndex(row, column);
+    } else if (parent.internalPointer() == 0 && parent.row() < m_headers.count()) {
+        HeaderItemData *header = m_headers.at(parent.row());
+        if (row < header->occurrences.count())
+            return createIndex(row, column, header);
+    }
+
+    return QModelIndex();
+}
+
+QModelIndex EventModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid() || child.internalPointer() == 0)
+        return QModelIndex();
+
+    HeaderItemData *header = static_cast<HeaderItemData *>(child.internalPointer());
+    return createIndex(header->row, 0);
+}
+
+int EventModel::rowCount(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return m_headers.count();
+
+    if (parent.internalPointer() == 0 && parent.column() == 0)
+        return m_headers.at(parent.row())->occurrences.count();
+
+    return 0;
+}
+
+int EventModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return 1;
+}
+
+QVariant EventModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    HeaderItemData *header = static_cast<HeaderItemData *>(index.internalPointer());
+    if (!header) {
+        header = m_headers.at(index.row());
+        switch (role) {
+            case Qt::DisplayRole:
+                if (header->date.isValid()) {
+                    QMap<QString, QVariant> data;
+                    data["itemType"] = HeaderItem;
+                    data["title"] = QString("<b>" + header->title + "</b>");
+                    data["date"] = QDateTime(header->date);
+                    return data;
+                }
+                return header->title; // status message, e.g. server not running
+            case Qt::ForegroundRole:
+                return QBrush(Plasma::Theme::defaultTheme()->color(Plasma::Theme::TextColor));
+            case SortRole:
+                return header->date.isValid() ? QVariant(QDateTime(header->date)) : QVariant();
+            case ItemTypeRole:
+                return HeaderItem;
+            case CollectionRole:
+            case UIDRole:
+                return QString();
+            case TooltipRole:
+                return QString("<qt><b>" + header->toolTip + "</b></qt>");
+            default:
+                return QVariant();
+        }
+    }
+
+    const int slot = header->occurrences.at(index.row());
+    switch (role) {
+        case Qt::DisplayRole:
+        case RecordRole:
+            return QVariant::fromValue(m_occurrences.record(slot));
+        case Qt::BackgroundRole: {
+            const QColor color = occurrenceBackground(slot);
+            return color.isValid() ? QVariant(QBrush(color)) : QVariant();
+        }
+        case Qt::ForegroundRole:
+            return QBrush(occurrenceForeground(slot));
+        case SortRole:
+            return m_occurrences.sortDateTime(slot);
+        case UIDRole:
+            return m_occurrences.uid(slot);
+        case ItemTypeRole:
+            return m_occurrences.type(slot);
+        case TooltipRole:
+            return tooltip(m_occurrences.itemId(slot), m_occurrences.revision(slot));
+        case ItemIDRole:
+            return m_occurrences.itemId(slot);
+        case CollectionRole:
+            return QString::number(m_occurrences.collectionId(slot));
+        case CategoriesRole:
+            return m_occurrences.categories(slot);
+        case MainCategoryRole:
+            return m_occurrences.mainCategory(slot);
+        case CompletedRole:
+            return m_occurrences.isCompleted(slot);
+        case EndDateRole:
+            return m_occurrences.endDate(slot);
+        default:
+            return QVariant();
+    }
+}
+
+EventModel::FilterKey EventModel::filterKey(const QModelIndex &index) const
+{
+    FilterKey key;
+    HeaderItemData *header = static_cast<HeaderItemData *>(index.internalPointer());
+    if (!header) {
+        header = m_headers.at(index.row());
+        key.header = header;
+        key.slot = -1;
+        key.type = HeaderItem;
+        key.day = header->date.isValid() ? header->date.toJulianDay() : 0;
+        key.endDay = 0;
+        key.completed = false;
+        key.collectionIndex = -1;
+        key.categories = 0;
+        return key;
+    }
+
+    const int slot = header->occurrences.at(index.row());
+    key.header = header;
+    key.slot = slot;
+    key.type = m_occurrences.type(slot);
+    key.day = m_occurrences.day(slot);
+    key.endDay = m_occurrences.endDay(slot);
+    key.completed = m_occurrences.isCompleted(slot);
+    key.collectionIndex = m_occurrences.collectionIndex(slot);
+    key.categories = &m_occurrences.categoryMask(slot);
+    return key;
+}
+
+FilterMask EventModel::collectionMask(const QStringList &collections)
+{
+    FilterMask mask;
+    foreach (const QString &collection, collections) {
+        mask.set(collectionIndex(collection.toLongLong()));
+    }
+    return mask;
+}
+
+FilterMask EventModel::categoryMask(const QStringList &categories)
+{
+    FilterMask mask;
+    foreach (const QString &category, categories) {
+        mask.set(categoryIndex(category));
+    }
+    return mask;
+}
+
+int EventModel::collectionIndex(Akonadi::Entity::Id id)
+{
+    QHash<Akonadi::Entity::Id, int>::const_iterator it = m_collectionIndexes.constFind(id);
+    if (it != m_collectionIndexes.constEnd())
+        return it.value();
+
+    const int index = m_collectionIndexes.count();
+    m_collectionIndexes.insert(id, index);
+    return index;
+}
+
+int EventModel::categoryIndex(const QString &category)
+{
+    QHash<QString, int>::const_iterator it = m_categoryIndexes.constFind(category);
+    if (it != m_categoryIndexes.constEnd())
+        return it.value();
+
+    const int index = m_categoryIndexes.count();
+    m_categoryIndexes.insert(category, index);
+    return index;
+}
+
+Qt::ItemFlags EventModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return 0;
+
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
+
+void EventModel::sort(int column, Qt::SortOrder order)
+{
+    Q_UNUSED(column);
+    Q_UNUSED(order);
+
+    foreach (HeaderItemData *header, m_headers) {
+        sortHeader(header);
+    }
+}
+
+void EventModel::sortHeader(HeaderItemData *header, int sortedCount)
+{
+    QVector<int> &occurrences = header->occurrences;
+    QVector<int> oldOccurrences;
+
+    if (header->row != -1) {
+        oldOccurrences = occurrences;
+        emit layoutAboutToBeChanged();
+    }
+
+    if (sortedCount > 0) { // both runs are already sorted, just merge them
+        std::inplace_merge(occurrences.begin(), occurrences.begin() + sortedCount, occurrences.end(), OccurrenceLessThan(m_occurrences));
+    } else {
+        qStableSort(occurrences.begin(), occurrences.end(), OccurrenceLessThan(m_occurrences));
+    }
+
+    if (header->row == -1)
+        return;
+
+    QHash<int, int> newRows;
+    for (int r = 0; r < occurrences.count(); ++r) {
+        newRows.insert(occurrences.at(r), r);
+    }
+
+    foreach (const QModelIndex &idx, persistentIndexList()) {
+        if (idx.internalPointer() == header) {
+            changePersistentIndex(idx, createIndex(newRows.value(oldOccurrences.at(idx.row())), 0, header));
+        }
+    }
+
+    emit layoutChanged();
+}
+
+int EventModel::occurrenceRow(HeaderItemData *header, int slot) const
+{
+    const QVector<int> &occurrences = header->occurrences;
+    const qint64 key = m_occurrences.sortKey(slot);
+
+    QVector<int>::const_iterator it = qLowerBound(occurrences.constBegin(), occurrences.constEnd(), slot, OccurrenceLessThan(m_occurrences));
+    for (; it != occurrences.constEnd() && m_occurrences.sortKey(*it) == key; ++it) {
+        if (*it == slot)
+            return it - occurrences.constBegin();
+    }
+
+    return -1;
 }
 
 void EventModel::initModel()
 {
-    createHeaderItems(m_headerPartsList);
+    if (m_sectionItemsMap.isEmpty())
+        createHeaderItems(m_headerPartsList);
+    m_fetching = true;
 
     Akonadi::CollectionFetchScope scope;
     QStringList mimeTypes;
@@ -81,51 +402,237 @@ void EventModel::initialCollectionFetchFinished(KJob *job)
 {
     if (job->error()) {
         kDebug() << "Initial collection fetch failed!";
+        // keep showing the snapshot, nothing to compare it with
+        m_snapshotItems.clear();
+        m_fetching = false;
     } else {
         Akonadi::CollectionFetchJob *cJob = qobject_cast<Akonadi::CollectionFetchJob *>(job);
-        Akonadi::Collection::List collections = cJob->collections();
-        foreach (const Akonadi::Collection &collection, collections) {
+        Akonadi::Collection::List collections;
+        foreach (const Akonadi::Collection &collection, cJob->collections()) {
             m_collections.insert(collection.id(), collection);
-            Akonadi::ItemFetchJob *job = new Akonadi::ItemFetchJob(collection);
-            job->fetchScope().fetchFullPayload();
-            job->fetchScope().setAncestorRetrieval( Akonadi::ItemFetchScope::Parent );
-            
-            connect(job, SIGNAL(result(KJob *)), this, SLOT(initialItemFetchFinished(KJob *)));
-            job->start();
+            if (m_excludedCollections.contains(collection.id())) {
+                // not fetched, but it must stay selectable in the collection dialog
+                m_usedCollections.insert(collection.name(), QString::number(collection.id()));
+            } else {
+                collections << collection;
+            }
         }
+        m_pendingFetches = collections.count();
+        updateMonitoredCollections();
+
+        // collections that had the most items last time come first
+        qStableSort(collections.begin(), collections.end(), CollectionPriorityGreaterThan(m_collectionPriority));
+        m_fetchQueue = collections;
+        startQueuedFetches();
+
+        if (m_pendingFetches == 0)
+            initialFetchDone();
+    }
+}
+
+void EventModel::startQueuedFetches()
+{
+    while (m_fetchTimes.count() < MaxConcurrentFetches && !m_fetchQueue.isEmpty()) {
+        const Akonadi::Collection collection = m_fetchQueue.takeFirst();
+        Akonadi::ItemFetchJob *job = new Akonadi::ItemFetchJob(collection);
+        job->fetchScope().fetchFullPayload();
+        job->fetchScope().setAncestorRetrieval( Akonadi::ItemFetchScope::Parent );
+        job->setProperty("collectionId", collection.id());
+
+        connect(job, SIGNAL(result(KJob *)), this, SLOT(initialItemFetchFinished(KJob *)));
+        m_fetchTimes.insert(job, QTime());
+        m_fetchTimes[job].start();
+        job->start();
     }
 }
 
 void EventModel::initialItemFetchFinished(KJob *job)
 {
+    if (!m_fetchTimes.contains(job)) // started before the last reset
+        return;
+
+    const int elapsed = m_fetchTimes.take(job).elapsed();
+    const Akonadi::Entity::Id collectionId = job->property("collectionId").toLongLong();
+    kDebug() << "Fetched collection" << m_collections.value(collectionId).name() << "in" << elapsed << "ms";
+    startQueuedFetches();
+
     if (job->error()) {
         kDebug() << "Initial item fetch failed!";
-    } else {
+        m_failedCollections.insert(collectionId);
+    } else if (!m_excludedCollections.contains(collectionId)) {
         Akonadi::ItemFetchJob *iJob = qobject_cast<Akonadi::ItemFetchJob *>(job);
-        Akonadi::Item::List items = iJob->items();
-        foreach (const Akonadi::Item &item, items) {
-            if (itemIds.contains(item.id())) {
-                removeItem(item);
-            }
+        const Akonadi::Item::List items = iJob->items();
+        if (!items.isEmpty()) {
+            // decode in the thread pool, the results are added in decodedItemsReady
+            QFutureWatcher<DecodedItem> *watcher = new QFutureWatcher<DecodedItem>(this);
+            connect(watcher, SIGNAL(resultsReadyAt(int, int)), this, SLOT(decodedItemsReady(int, int)));
+            connect(watcher, SIGNAL(finished()), this, SLOT(decodingFinished()));
+            m_decodeWatchers.insert(watcher);
+            watcher->setFuture(QtConcurrent::mapped(items, decoder()));
+            return;
+        }
+    }
 
-            if (item.hasPayload <KCalCore::Event::Ptr>()) {
-                KCalCore::Event::Ptr event = item.payload <KCalCore::Event::Ptr>();
-                if (event) {
-                    addEventItem(eventDetails(item, event));
-                    itemIds.append(item.id());
-                } // if event
-            } else if (item.hasPayload <KCalCore::Todo::Ptr>()) {
-                KCalCore::Todo::Ptr todo = item.payload<KCalCore::Todo::Ptr>();
-                if (todo) {
-                    addTodoItem(todoDetails(item, todo));
-                    itemIds.append(item.id());
-                }
-            } // if hasPayload
-        } // foreach
+    if (--m_pendingFetches == 0)
+        initialFetchDone();
+}
+
+void EventModel::decodedItemsReady(int begin, int end)
+{
+    QFutureWatcher<DecodedItem> *watcher = static_cast<QFutureWatcher<DecodedItem> *>(sender());
+    if (!m_decodeWatchers.contains(watcher))
+        return;
+
+    m_bulkInsert = true;
+    for (int i = begin; i < end; ++i) {
+        const DecodedItem decoded = watcher->resultAt(i);
+        m_snapshotItems.remove(decoded.item.id());
+
+        // the monitor may have delivered a newer revision while this one was decoded
+        const QVector<int> itemSlots = m_itemOccurrences.value(decoded.item.id());
+        if (!itemSlots.isEmpty() && m_occurrences.revision(itemSlots.first()) > decoded.item.revision())
+            continue;
+
+        // items shown from the snapshot keep their rows unless they changed
+        if (m_excludedCollections.contains(decoded.item.storageCollectionId()) || isUnchanged(decoded))
+            continue;
+        if (itemSlots.isEmpty()) {
+            addDecodedItem(decoded);
+        } else {
+            updateDecodedItem(decoded);
+        }
     }
-    
-    setSortRole(EventModel::SortRole);
-    sort(0, Qt::AscendingOrder);
+    m_bulkInsert = false;
+    insertPendingOccurrences();
+}
+
+void EventModel::decodingFinished()
+{
+    QFutureWatcher<DecodedItem> *watcher = static_cast<QFutureWatcher<DecodedItem> *>(sender());
+    if (!m_decodeWatchers.remove(watcher))
+        return;
+
+    watcher->deleteLater();
+    if (--m_pendingFetches == 0)
+        initialFetchDone();
+}
+
+void EventModel::cancelDecoding()
+{
+    foreach (QFutureWatcher<DecodedItem> *watcher, m_decodeWatchers) {
+        watcher->cancel();
+        watcher->waitForFinished();
+        delete watcher;
+    }
+    m_decodeWatchers.clear();
+}
+
+IncidenceDecoder EventModel::decoder()
+{
+    return IncidenceDecoder(m_collections, &m_recurrenceCache, expansionDays(), recurringCount);
+}
+
+void EventModel::initialFetchDone()
+{
+    // snapshot items that Akonadi does not know anymore, those of failed
+    // collections are kept until the collection is fetched again
+    QHash<Akonadi::Item::Id, Akonadi::Entity::Id>::iterator it = m_snapshotItems.begin();
+    while (it != m_snapshotItems.end()) {
+        if (!m_failedCollections.contains(it.value())) {
+            removeItem(Akonadi::Item(it.key()));
+            it = m_snapshotItems.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    m_fetching = false;
+    scheduleSnapshot();
+}
+
+void EventModel::resourceOnline(const QString &resource)
+{
+    if (m_failedCollections.isEmpty())
+        return;
+
+    QSet<Akonadi::Entity::Id>::iterator it = m_failedCollections.begin();
+    while (it != m_failedCollections.end()) {
+        const Akonadi::Collection collection = m_collections.value(*it);
+        if (collection.resource() == resource) {
+            kDebug() << "Fetching collection" << collection.name() << "again";
+            m_fetchQueue.append(collection);
+            ++m_pendingFetches;
+            it = m_failedCollections.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (!m_fetchQueue.isEmpty()) {
+        m_fetching = true;
+        startQueuedFetches();
+    }
+}
+
+void EventModel::loadSnapshot()
+{
+    if (m_sectionItemsMap.isEmpty())
+        createHeaderItems(m_headerPartsList);
+
+    const QList<EventSnapshot::Entry> entries = m_snapshot.load();
+    m_collectionPriority.clear();
+    m_bulkInsert = true;
+    foreach (const EventSnapshot::Entry &entry, entries) {
+        const IncidenceRecord &record = entry.record;
+        ++m_collectionPriority[record.collectionId];
+        if (m_excludedCollections.contains(record.collectionId))
+            continue;
+        m_usedCollections.insert(record.collectionName, QString::number(record.collectionId));
+        m_snapshotItems.insert(record.itemId, record.collectionId);
+        if (record.itemType == TodoItem) {
+            // the stored "some day" date is as old as the snapshot
+            IncidenceRecord todo = record;
+            if (!todo.hasDueDate)
+                todo.dueDate = QDateTime(QDate::currentDate().addDays(366));
+            addTodoItem(todo, entry.recurDates);
+        } else {
+            addEventItem(record, entry.recurDates);
+        }
+    }
+    m_bulkInsert = false;
+    insertPendingOccurrences();
+}
+
+void EventModel::scheduleSnapshot()
+{
+    m_snapshotTimer->start();
+}
+
+void EventModel::saveSnapshot()
+{
+    // an incomplete fetch would drop the items of the other collections
+    if (m_fetching)
+        return;
+
+    QList<EventSnapshot::Entry> entries;
+    QHash<Akonadi::Item::Id, QVector<int> >::const_iterator it;
+    for (it = m_itemOccurrences.constBegin(); it != m_itemOccurrences.constEnd(); ++it) {
+        const QVector<int> &occurrences = it.value();
+        if (occurrences.isEmpty())
+            continue;
+
+        EventSnapshot::Entry entry;
+        entry.record = m_occurrences.incidence(occurrences.first())->record;
+        if (entry.record.recurs) {
+            foreach (int slot, occurrences) {
+                entry.recurDates << m_occurrences.sortDateTime(slot);
+            }
+            qSort(entry.recurDates);
+        }
+        entries << entry;
+    }
+
+    m_snapshot.save(entries);
 }
 
 void EventModel::initMonitor()
@@ -136,7 +643,7 @@ void EventModel::initMonitor()
     scope.fetchAllAttributes(true);
     m_monitor->fetchCollection(true);
     m_monitor->setItemFetchScope(scope);
-    m_monitor->setCollectionMonitored(Akonadi::Collection::root());
+    updateMonitoredCollections();
     m_monitor->setMimeTypeMonitored(KCalCore::Event::eventMimeType(), true);
     m_monitor->setMimeTypeMonitored(KCalCore::Todo::todoMimeType(), true);
     m_monitor->setMimeTypeMonitored("text/calendar", true);
@@ -149,46 +656,222 @@ void EventModel::initMonitor()
                        SLOT(itemChanged(const Akonadi::Item &, const QSet<QByteArray> &)));
     connect(m_monitor, SIGNAL(itemMoved(const Akonadi::Item &, const Akonadi::Collection &, const Akonadi::Collection &)),
                        SLOT(itemMoved(const Akonadi::Item &, const Akonadi::Collection &, const Akonadi::Collection &)));
+
+    // the root is not watched while collections are excluded, new calendars
+    // are reported by a monitor that only listens for added collections
+    m_collectionMonitor = new Akonadi::Monitor(this);
+    m_collectionMonitor->setCollectionMonitored(Akonadi::Collection::root());
+    connect(m_collectionMonitor, SIGNAL(collectionAdded(const Akonadi::Collection &, const Akonadi::Collection &)),
+                                 SLOT(collectionAdded(const Akonadi::Collection &, const Akonadi::Collection &)));
+}
+
+void EventModel::updateMonitoredCollections()
+{
+    if (!m_monitor)
+        return;
+
+    // without exclusions the root is watched, so new collections show up too
+    const bool all = m_excludedCollections.isEmpty();
+    m_monitor->setCollectionMonitored(Akonadi::Collection::root(), all);
+    foreach (const Akonadi::Collection &collection, m_collections) {
+        m_monitor->setCollectionMonitored(collection, !all && !m_excludedCollections.contains(collection.id()));
+    }
 }
 
-void EventModel::initHeaderItem(QStandardItem *item, QString title, QString toolTip, int days)
+EventModel::HeaderItemData *EventModel::initHeaderItem(QString title, QString toolTip, int days)
 {
-    QMap<QString, QVariant> data;
-    QDateTime date = QDateTime(QDate::currentDate().addDays(days));
-    data["itemType"] = HeaderItem;
-    data["title"] = QString("<b>" + title + "</b>");
-    data["date"] = date;
-    item->setData(data, Qt::DisplayRole);
-    QColor textColor = Plasma::Theme::defaultTheme()->color(Plasma::Theme::TextColor);
-    item->setForeground(QBrush(textColor));
-    item->setData(QVariant(date), SortRole);
-    item->setData(QVariant(HeaderItem), ItemTypeRole);
-    item->setData(QVariant(QString()), CollectionRole);
-    item->setData(QVariant(QString()), UIDRole);
-    item->setData(QVariant("<qt><b>" + toolTip + "</b></qt>"), TooltipRole);
+    HeaderItemData *header = new HeaderItemData;
+    header->title = title;
+    header->toolTip = toolTip;
+    header->date = QDate::currentDate().addDays(days);
+    header->row = -1;
+    header->autoGroup = false;
+
+    return header;
 }
 
-void EventModel::resetModel()
+void EventModel::insertHeaderRow(HeaderItemData *header)
+{
+    int pos = 0;
+    while (pos < m_headers.count() && m_headers.at(pos)->date <= header->date) {
+        ++pos;
+    }
+
+    beginInsertRows(QModelIndex(), pos, pos);
+    m_headers.insert(pos, header);
+    for (int r = pos; r < m_headers.count(); ++r) {
+        m_headers.at(r)->row = r;
+    }
+    endInsertRows();
+}
+
+void EventModel::removeHeaderRow(HeaderItemData *header)
+{
+    const int pos = header->row;
+
+    beginRemoveRows(QModelIndex(), pos, pos);
+    m_headers.removeAt(pos);
+    header->row = -1;
+    for (int r = pos; r < m_headers.count(); ++r) {
+        m_headers.at(r)->row = r;
+    }
+    endRemoveRows();
+}
+
+void EventModel::clearModel()
 {
-    clear();
+    QSet<HeaderItemData *> headers = m_sectionItemsMap.values().toSet() + m_headers.toSet();
+    qDeleteAll(headers);
+    m_headers.clear();
     m_sectionItemsMap.clear();
+    m_headerTable.clear();
+    m_occurrences.clear();
     m_collections.clear();
     m_usedCollections.clear();
-    itemIds.clear();
-    parentItem = invisibleRootItem();
+    m_itemOccurrences.clear();
+    m_occurrenceHeaders.clear();
+    m_pendingOccurrences.clear();
+    m_recurringItems.clear();
+    m_laterItems.clear();
+    m_transitions.clear();
+    m_transitionSlots.clear();
+    m_transitionTimer->stop();
+    cancelDecoding();
+    m_snapshotItems.clear();
+    m_failedCollections.clear();
+    m_fetchQueue.clear();
+    m_fetchTimes.clear();
+    m_pendingFetches = 0;
+    m_fetching = false;
     delete m_monitor;
     m_monitor = 0;
+    delete m_collectionMonitor;
+    m_collectionMonitor = 0;
+}
 
-    if (!Akonadi::ServerManager::isRunning()) {
-        QStandardItem *errorItem = new QStandardItem();
-        errorItem->setData(QVariant(i18n("The Akonadi server is not running.")), Qt::DisplayRole);
-        parentItem->appendRow(errorItem);
-    } else {
+void EventModel::resetModel()
+{
+    m_recurrenceCache.save();
+    if (m_snapshotTimer->isActive())
+        saveSnapshot();
+
+    beginResetModel();
+    clearModel();
+
+    const bool serverRunning = Akonadi::ServerManager::isRunning();
+    if (!serverRunning) {
+        HeaderItemData *errorItem = new HeaderItemData;
+        errorItem->title = i18n("The Akonadi server is not running.");
+        errorItem->row = 0;
+        errorItem->autoGroup = false;
+        m_headers.append(errorItem);
+    }
+    endResetModel();
+
+    if (serverRunning) {
+        loadSnapshot();
         initModel();
         initMonitor();
     }
 }
 
+void EventModel::dayChanged()
+{
+    const QDate today = QDate::currentDate();
+    const int days = m_headerTableStart.daysTo(today.addDays(HeaderTableFirstDay));
+    if (m_sectionItemsMap.isEmpty() || days <= 0)
+        return;
+
+    // expand the recurring items for the new window first, while their
+    // occurrences are still registered, so the unchanged ones are matched
+    // and the ones that are not produced anymore are removed
+    m_bulkInsert = true;
+    const QList<Akonadi::Item> items = m_recurringItems.values();
+    foreach (const Akonadi::Item &item, items) {
+        updateItem(item);
+    }
+
+    // headers relative to today move along, group headers of past days
+    // or of the day a relative header moved onto go away
+    QList<HeaderItemData *> groupHeaders;
+    const QList<HeaderItemData *> headers = m_sectionItemsMap.values();
+    m_sectionItemsMap.clear();
+    foreach (HeaderItemData *header, headers) {
+        if (header->autoGroup) {
+            groupHeaders.append(header);
+        } else {
+            header->date = header->date.addDays(days);
+            m_sectionItemsMap.insert(header->date, header);
+        }
+    }
+
+    QVector<int> orphans;
+    foreach (HeaderItemData *header, groupHeaders) {
+        if (header->date >= today && !m_sectionItemsMap.contains(header->date)) {
+            m_sectionItemsMap.insert(header->date, header);
+            continue;
+        }
+
+        if (header->row != -1)
+            removeHeaderRow(header);
+        orphans += header->occurrences;
+        removeOccurrenceRows(header, 0, header->occurrences.count() - 1, false);
+        delete header;
+    }
+    rebuildHeaderTable();
+
+    // find the occurrences that belong to another header now
+    QVector<int> moved;
+    const QList<HeaderItemData *> remaining = m_sectionItemsMap.values();
+    foreach (HeaderItemData *header, remaining) {
+        foreach (int slot, header->occurrences) {
+            const IncidencePtr incidence = m_occurrences.incidence(slot);
+            if (m_occurrences.type(slot) == TodoItem && !incidence->record.hasDueDate) {
+                // todos without due date are kept one day behind "some day"
+                m_occurrences.setSortDateTime(slot, m_occurrences.sortDateTime(slot).addDays(days));
+            } else if (headerItemForDate(m_occurrences.sortDateTime(slot).date()) != header) {
+                moved.append(slot);
+            }
+        }
+    }
+    removeOccurrences(moved, false);
+
+    foreach (int slot, moved + orphans) {
+        unregisterOccurrence(slot);
+        if (headerItemForDate(m_occurrences.sortDateTime(slot).date())) {
+            m_pendingOccurrences.append(slot);
+        } else { // expired
+            m_occurrences.remove(slot);
+        }
+    }
+
+    // items that were too far ahead, the ones of the new days are added now
+    const QDate lastDay = today.addDays(365);
+    QHash<Akonadi::Item::Id, IncidenceRecord>::iterator later = m_laterItems.begin();
+    while (later != m_laterItems.end()) {
+        const IncidenceRecord record = later.value();
+        const QDate day = record.itemType == TodoItem ? record.dueDate.date() : record.startDate.date();
+        if (day > lastDay) {
+            ++later;
+            continue;
+        }
+
+        later = m_laterItems.erase(later);
+        if (record.itemType == TodoItem) {
+            addTodoItem(record, QList<QDateTime>());
+        } else {
+            addEventItem(record, QList<QDateTime>());
+        }
+    }
+
+    m_bulkInsert = false;
+    insertPendingOccurrences();
+
+    if (!m_headers.isEmpty())
+        emit dataChanged(index(0, 0), index(m_headers.count() - 1, 0));
+    scheduleSnapshot();
+}
+
 void EventModel::settingsChanged(int urgencyTime, int birthdayTime, QList<QColor> itemColors, int count, bool autoGroupHeader)
 {
     urgency = urgencyTime;
@@ -199,11 +882,97 @@ void EventModel::settingsChanged(int urgencyTime, int birthdayTime, QList<QColor
     finishedTodoBg = itemColors.at(finishedTodoColorPos);
     recurringCount = count;
     useAutoGroupHeader = autoGroupHeader;
+
+    rescheduleTransitions();
+    refreshColors();
+}
+
+void EventModel::setPeriod(int period)
+{
+    const int oldDays = expansionDays();
+    m_period = period;
+
+    if (expansionDays() > oldDays) {
+        // recurring incidences are only expanded up to the period, add the missing occurrences
+        const QList<Akonadi::Item> items = m_recurringItems.values();
+        foreach (const Akonadi::Item &item, items) {
+            updateItem(item);
+        }
+    }
+}
+
+void EventModel::setExcludedCollections(const QStringList &collections)
+{
+    QSet<Akonadi::Entity::Id> excluded;
+    foreach (const QString &id, collections) {
+        excluded.insert(id.toLongLong());
+    }
+
+    const QSet<Akonadi::Entity::Id> added = excluded - m_excludedCollections;
+    const QSet<Akonadi::Entity::Id> removed = m_excludedCollections - excluded;
+    m_excludedCollections = excluded;
+
+    if (!added.isEmpty()) {
+        QList<Akonadi::Item::Id> items;
+        QHash<Akonadi::Item::Id, QVector<int> >::const_iterator it;
+        for (it = m_itemOccurrences.constBegin(); it != m_itemOccurrences.constEnd(); ++it) {
+            if (!it.value().isEmpty() && added.contains(m_occurrences.collectionId(it.value().first())))
+                items << it.key();
+        }
+        foreach (Akonadi::Item::Id id, items) {
+            m_snapshotItems.remove(id);
+            removeItem(Akonadi::Item(id));
+        }
+
+        bool dequeued = false;
+        for (int i = m_fetchQueue.count() - 1; i >= 0; --i) {
+            if (added.contains(m_fetchQueue.at(i).id())) {
+                m_fetchQueue.removeAt(i);
+                --m_pendingFetches;
+                dequeued = true;
+            }
+        }
+        if (dequeued && m_pendingFetches == 0)
+            initialFetchDone();
+    }
+
+    // fetch only the collections that were enabled again
+    foreach (Akonadi::Entity::Id id, removed) {
+        if (m_collections.contains(id)) {
+            m_fetchQueue << m_collections.value(id);
+            ++m_pendingFetches;
+            m_fetching = true;
+        }
+    }
+    startQueuedFetches();
+
+    updateMonitoredCollections();
 }
 
 void EventModel::setCategoryColors(QHash<QString, QColor> categoryColors)
 {
     m_categoryColors = categoryColors;
+    refreshColors();
+}
+
+void EventModel::refreshColors()
+{
+    if (m_headers.isEmpty())
+        return;
+
+    // the colors are looked up in data(), the views just need to ask again
+    emit dataChanged(index(0, 0), index(m_headers.count() - 1, 0));
+    foreach (HeaderItemData *header, m_headers) {
+        if (!header->occurrences.isEmpty()) {
+            const QModelIndex parent = createIndex(header->row, 0);
+            emit dataChanged(index(0, 0, parent), index(header->occurrences.count() - 1, 0, parent));
+        }
+    }
+}
+
+void EventModel::rowsChanged(const QModelIndex &parent, int first, int last)
+{
+    emit dataChanged(index(first, 0, parent), index(last, 0, parent));
 }
 
 void EventModel::setHeaderItems(QStringList headerParts)
@@ -213,21 +982,20 @@ void EventModel::setHeaderItems(QStringList headerParts)
 
 void EventModel::createHeaderItems(QStringList headerParts)
 {
-    QStandardItem *olderItem = new QStandardItem();
-    initHeaderItem(olderItem, i18n("Earlier stuff"), i18n("Unfinished todos, still ongoing earlier events, etc."), -28);
-    m_sectionItemsMap.insert(olderItem->data(SortRole).toDate(), olderItem);
+    HeaderItemData *olderItem = initHeaderItem(i18n("Earlier stuff"), i18n("Unfinished todos, still ongoing earlier events, etc."), -28);
+    m_sectionItemsMap.insert(olderItem->date, olderItem);
 
-    QStandardItem *somedayItem = new QStandardItem();
-    initHeaderItem(somedayItem, i18n("Some day"), i18n("Todos with no due date"), 366);
-    m_sectionItemsMap.insert(somedayItem->data(SortRole).toDate(), somedayItem);
+    HeaderItemData *somedayItem = initHeaderItem(i18n("Some day"), i18n("Todos with no due date"), 366);
+    m_sectionItemsMap.insert(somedayItem->date, somedayItem);
 
     if (!useAutoGroupHeader) {
         for (int i = 0; i < headerParts.size(); i += 3) {
-            QStandardItem *item = new QStandardItem();
-            initHeaderItem(item, headerParts.value(i), headerParts.value(i + 1), headerParts.value(i + 2).toInt());
-            m_sectionItemsMap.insert(item->data(SortRole).toDate(), item);
+            HeaderItemData *item = initHeaderItem(headerParts.value(i), headerParts.value(i + 1), headerParts.value(i + 2).toInt());
+            m_sectionItemsMap.insert(item->date, item);
         }
     }
+
+    rebuildHeaderTable();
 }
 
 void EventModel::itemAdded(const Akonadi::Item &item, const Akonadi::Collection &collection)
@@ -238,379 +1006,682 @@ void EventModel::itemAdded(const Akonadi::Item &item, const Akonadi::Collection
 
 void EventModel::removeItem(const Akonadi::Item &item)
 {
-    foreach (QStandardItem *i, m_sectionItemsMap) {
-        QModelIndexList l;
-        if (i->hasChildren())
-            l = match(i->child(0, 0)->index(), EventModel::ItemIDRole, item.id(), -1);
+    m_recurringItems.remove(item.id());
+    m_laterItems.remove(item.id());
+
+    const QVector<int> occurrences = m_itemOccurrences.take(item.id());
+    if (occurrences.isEmpty())
+        return;
+
+    scheduleSnapshot();
+    removeOccurrences(occurrences);
+}
+
+void EventModel::removeOccurrences(const QVector<int> &occurrences, bool release)
+{
+    QMap<HeaderItemData *, QList<int> > headerRows;
+    foreach (int slot, occurrences) {
+        HeaderItemData *header = m_occurrenceHeaders.at(slot);
+        const int r = occurrenceRow(header, slot);
+        Q_ASSERT(r != -1);
+        headerRows[header].append(r);
+    }
 
-        for (int c = l.count(); c > 0; --c) {
-            emit layoutAboutToBeChanged();
-            i->removeRow(l.at(c - 1).row());
-            emit layoutChanged();
+    QMap<HeaderItemData *, QList<int> >::iterator it;
+    for (it = headerRows.begin(); it != headerRows.end(); ++it) {
+        HeaderItemData *header = it.key();
+        QList<int> &rows = it.value();
+
+        if (header->row != -1 && rows.count() == header->occurrences.count()) {
+            // the header would be empty, drop it together with its children
+            removeHeaderRow(header);
+            removeOccurrenceRows(header, 0, header->occurrences.count() - 1, release);
+            continue;
         }
 
-        int r = i->row();
-        if (r != -1 && !i->hasChildren()) {
-            emit layoutAboutToBeChanged();
-            takeRow(r);
-            emit layoutChanged();
-            emit modelNeedsExpanding();
+        // remove contiguous ranges back to front, so the rows in front stay valid
+        qSort(rows);
+        int last = rows.count() - 1;
+        while (last >= 0) {
+            int first = last;
+            while (first > 0 && rows.at(first - 1) == rows.at(first) - 1) {
+                --first;
+            }
+            removeOccurrenceRows(header, rows.at(first), rows.at(last), release);
+            last = first - 1;
         }
     }
+}
+
+void EventModel::removeOccurrenceRows(HeaderItemData *header, int first, int last, bool release)
+{
+    if (header->row != -1)
+        beginRemoveRows(createIndex(header->row, 0), first, last);
+
+    for (int r = first; r <= last; ++r) {
+        const int slot = header->occurrences.at(r);
+        if (release)
+            m_occurrences.remove(slot);
+        m_occurrenceHeaders[slot] = 0;
+    }
+    header->occurrences.remove(first, last - first + 1);
 
-    itemIds.removeAll(item.id());
+    if (header->row != -1)
+        endRemoveRows();
 }
 
 void EventModel::itemChanged(const Akonadi::Item &item, const QSet<QByteArray> &)
 {
     kDebug() << "item changed";
-    removeItem(item);
-    addItem(item, item.parentCollection());
+    updateItem(item);
 }
 
 void EventModel::itemMoved(const Akonadi::Item &item, const Akonadi::Collection &, const Akonadi::Collection &)
 {
     kDebug() << "item moved";
-    removeItem(item);
-    addItem(item, item.parentCollection());
+    updateItem(item);
+}
+
+void EventModel::collectionAdded(const Akonadi::Collection &collection, const Akonadi::Collection &)
+{
+    const QStringList mimeTypes = collection.contentMimeTypes();
+    if (!mimeTypes.contains(KCalCore::Event::eventMimeType()) && !mimeTypes.contains(KCalCore::Todo::todoMimeType())
+        && !mimeTypes.contains("text/calendar"))
+        return;
+
+    kDebug() << "collection added" << collection.name();
+    m_collections.insert(collection.id(), collection);
+    updateMonitoredCollections();
+
+    // items it was created with are fetched like those of the other collections
+    m_fetchQueue.append(collection);
+    ++m_pendingFetches;
+    m_fetching = true;
+    startQueuedFetches();
+}
+
+void EventModel::updateItem(const Akonadi::Item &item)
+{
+    updateDecodedItem(decoder()(item));
+}
+
+void EventModel::updateDecodedItem(const DecodedItem &decoded)
+{
+    const Akonadi::Item &item = decoded.item;
+    scheduleSnapshot();
+    if (m_excludedCollections.contains(item.storageCollectionId())) {
+        removeItem(item);
+        return;
+    }
+
+    QVector<int> oldSlots = m_itemOccurrences.take(item.id());
+    m_recurringItems.remove(item.id());
+
+    // collect the new occurrences as pending, they are matched against the old ones first
+    const bool bulkInsert = m_bulkInsert;
+    const int firstNew = m_pendingOccurrences.count();
+    m_bulkInsert = true;
+    addDecodedItem(decoded);
+    m_bulkInsert = bulkInsert;
+
+    QVector<int> newSlots = m_pendingOccurrences.mid(firstNew);
+    m_pendingOccurrences.resize(firstNew);
+
+    OccurrenceLessThan lessThan(m_occurrences);
+    qStableSort(oldSlots.begin(), oldSlots.end(), lessThan);
+    qStableSort(newSlots.begin(), newSlots.end(), lessThan);
+
+    QVector<int> removed;
+    int i = 0, j = 0;
+    while (i < oldSlots.count() || j < newSlots.count()) {
+        if (j == newSlots.count() || (i < oldSlots.count() && lessThan(oldSlots.at(i), newSlots.at(j)))) {
+            removed.append(oldSlots.at(i++));
+        } else if (i == oldSlots.count() || lessThan(newSlots.at(j), oldSlots.at(i))) {
+            m_pendingOccurrences.append(newSlots.at(j++));
+        } else {
+            // same start, the row keeps its place and only its values change
+            const int slot = oldSlots.at(i++);
+            const int newSlot = newSlots.at(j++);
+            m_occurrences.replace(slot, newSlot);
+            m_occurrences.remove(newSlot);
+            m_itemOccurrences[item.id()].append(slot);
+
+            // the new slot was never placed, its state is not set
+            const QDateTime now = QDateTime::currentDateTime();
+            updateOccurrenceState(slot, now);
+            scheduleTransition(slot, now);
+
+            HeaderItemData *header = m_occurrenceHeaders.at(slot);
+            if (header->row != -1) {
+                const QModelIndex idx = createIndex(occurrenceRow(header, slot), 0, header);
+                emit dataChanged(idx, idx);
+            }
+        }
+    }
+
+    removeOccurrences(removed);
+    if (!m_bulkInsert)
+        insertPendingOccurrences();
+}
+
+bool EventModel::isUnchanged(const DecodedItem &decoded) const
+{
+    // recurring items are matched occurrence by occurrence, their window may have moved
+    const QVector<int> itemSlots = m_itemOccurrences.value(decoded.item.id());
+    if (!decoded.valid || decoded.record.recurs || itemSlots.count() != 1)
+        return false;
+
+    // the flags that depend on the time of decoding count as well
+    const IncidenceRecord &stored = m_occurrences.incidence(itemSlots.first())->record;
+    const IncidenceRecord &record = decoded.record;
+    return stored.revision == record.revision && stored.collectionId == record.collectionId
+        && stored.startDate == record.startDate && stored.endDate == record.endDate
+        && stored.dueDate == record.dueDate && stored.isOverdue == record.isOverdue
+        && stored.inProgress == record.inProgress;
 }
 
 void EventModel::addItem(const Akonadi::Item &item, const Akonadi::Collection &collection)
 {
     Q_UNUSED(collection);
     
-    if (itemIds.contains(item.id())) {
+    if (m_itemOccurrences.contains(item.id())) {
         removeItem(item);
     }
+    scheduleSnapshot();
 
-    if (item.hasPayload<KCalCore::Event::Ptr>()) {
-        KCalCore::Event::Ptr event = item.payload <KCalCore::Event::Ptr>();
-        if (event) {
-            addEventItem(eventDetails(item, event));
-            itemIds.append(item.id());
-        } // if event
-    } else if (item.hasPayload <KCalCore::Todo::Ptr>()) {
-        KCalCore::Todo::Ptr todo = item.payload<KCalCore::Todo::Ptr>();
-        if (todo) {
-            addTodoItem(todoDetails(item, todo));
-            itemIds.append(item.id());
-        }
-    }
+    if (m_excludedCollections.contains(item.storageCollectionId()))
+        return;
+
+    addDecodedItem(decoder()(item));
 }
 
-void EventModel::addEventItem(const QMap<QString, QVariant> &values)
+void EventModel::addDecodedItem(const DecodedItem &decoded)
 {
-    QMap<QString, QVariant> data = values;
-    QString category = values["mainCategory"].toString();
-    QColor textColor = Plasma::Theme::defaultTheme()->color(Plasma::Theme::TextColor);
+    if (m_itemOccurrences.contains(decoded.item.id())) {
+        removeItem(decoded.item);
+    }
+    m_laterItems.remove(decoded.item.id());
+
+    if (!decoded.valid)
+        return;
+
+    const IncidenceRecord &record = decoded.record;
+    m_usedCollections.insert(record.collectionName, QString::number(record.collectionId));
+    if (record.recurs)
+        m_recurringItems.insert(record.itemId, decoded.item);
+
+    if (record.itemType == TodoItem) {
+        addTodoItem(record, decoded.recurDates);
+    } else {
+        addEventItem(record, decoded.recurDates);
+    }
+}
 
-    // dont add events starting later than a year
-    if (values["startDate"].toDate() > QDate::currentDate().addDays(365)) {
+void EventModel::addEventItem(const IncidenceRecord &record, const QList<QDateTime> &recurDates)
+{
+    // dont add events starting later than a year, dayChanged() adds them once their day comes
+    if (record.startDate.date() > QDate::currentDate().addDays(365)) {
+        if (!record.recurs) // recurring ones are expanded again anyway
+            m_laterItems.insert(record.itemId, record);
         return;
     }
 
-    if (values["recurs"].toBool()) {
+    IncidencePtr incidence = createIncidence(record);
+
+    if (record.recurs) {
+        int type = NormalItem;
+        if (record.isBirthday) {
+            type = BirthdayItem;
+        } else if (record.isAnniversary) {
+            type = AnniversaryItem;
+        }
+
         int c = 0;
-        QList<QVariant> dtTimes = values["recurDates"].toList();
-        foreach (const QVariant &eventDtTime, dtTimes) {
+        foreach (const QDateTime &eventDtTime, recurDates) {
             if (recurringCount != 0 && c >= recurringCount)
                 break;
 
-            QStandardItem *eventItem = new QStandardItem();
-            eventItem->setForeground(QBrush(textColor));
-            data["startDate"] = eventDtTime;
-
-            int d = values["startDate"].toDateTime().secsTo(values["endDate"].toDateTime());
-            data["endDate"] = eventDtTime.toDateTime().addSecs(d);
-
-            QDate itemDt = eventDtTime.toDate();
-            if (values["isBirthday"].toBool()) {
-                data["itemType"] = BirthdayItem;
-                int n = eventDtTime.toDate().year() - values["startDate"].toDate().year();
-                n > 2000 ? data["yearsSince"] = "XX" : data["yearsSince"] = QString::number(n); // workaround missing facebook birthdays
-                if (itemDt >= QDate::currentDate() && QDate::currentDate().daysTo(itemDt) < birthdayUrgency) {
-                    eventItem->setBackground(QBrush(urgentBg));
-                } else {
-                    if (m_categoryColors.contains(i18n("Birthday")) || m_categoryColors.contains("Birthday")) {
-                        QString b = "Birthday";
-                        if (m_categoryColors.contains(i18n("Birthday"))) {
-                            b = i18n("Birthday");
-                        }
-                        eventItem->setBackground(QBrush(m_categoryColors.value(b)));
-                    }
-                }
-                eventItem->setData(QVariant(BirthdayItem), ItemTypeRole);
-            } else if (values["isAnniversary"].toBool()) {
-                data["itemType"] = AnniversaryItem;
-                int n = eventDtTime.toDate().year() - values["startDate"].toDate().year();
-                data["yearsSince"] = QString::number(n);
-                if (itemDt >= QDate::currentDate() && QDate::currentDate().daysTo(itemDt) < birthdayUrgency) {
-                    eventItem->setBackground(QBrush(urgentBg));
-                } else {
-                    if (m_categoryColors.contains(category)) {
-                        eventItem->setBackground(QBrush(m_categoryColors.value(category)));
-                    }
-                }
-                eventItem->setData(QVariant(AnniversaryItem), ItemTypeRole);
-            } else {
-                data["itemType"] = NormalItem;
-                eventItem->setData(QVariant(NormalItem), ItemTypeRole);
-                QDateTime itemDtTime = data["startDate"].toDateTime();
-                if (itemDtTime > QDateTime::currentDateTime() && QDateTime::currentDateTime().secsTo(itemDtTime) < urgency * 60) {
-                    eventItem->setBackground(QBrush(urgentBg));
-                } else if (QDateTime::currentDateTime() > itemDtTime) {
-                    eventItem->setForeground(QBrush(passedFg));
-                } else if (m_categoryColors.contains(category)) {
-                    eventItem->setBackground(QBrush(m_categoryColors.value(category)));
-                }
-            }
-
-            eventItem->setData(data, Qt::DisplayRole);
-            eventItem->setData(eventDtTime, SortRole);
-            eventItem->setData(values["uid"], UIDRole);
-            eventItem->setData(values["itemid"], ItemIDRole);
-            eventItem->setData(values["collectionId"], CollectionRole);
-            eventItem->setData(values["tooltip"], TooltipRole);
-
-            addItemRow(eventDtTime.toDate(), eventItem);
+            int d = record.startDate.secsTo(record.endDate);
+            int slot = m_occurrences.append(incidence, type, eventDtTime, eventDtTime.addSecs(d));
+            addItemRow(eventDtTime.date(), slot);
 
             ++c;
         }
     } else {
-        QStandardItem *eventItem;
-        eventItem = new QStandardItem();
-        data["itemType"] = NormalItem;
-        eventItem->setData(QVariant(NormalItem), ItemTypeRole);
-        eventItem->setForeground(QBrush(textColor));
-        eventItem->setData(data, Qt::DisplayRole);
-        eventItem->setData(values["startDate"], SortRole);
-        eventItem->setData(values["uid"], EventModel::UIDRole);
-        eventItem->setData(values["itemid"], ItemIDRole);
-        eventItem->setData(values["collectionId"], CollectionRole);
-        eventItem->setData(values["tooltip"], TooltipRole);
-        QDateTime itemDtTime = values["startDate"].toDateTime();
-        if (itemDtTime > QDateTime::currentDateTime() && QDateTime::currentDateTime().secsTo(itemDtTime) < urgency * 60) {
-            eventItem->setBackground(QBrush(urgentBg));
-        } else if (QDateTime::currentDateTime() > itemDtTime) {
-            eventItem->setForeground(QBrush(passedFg));
-        } else if (m_categoryColors.contains(category)) {
-            eventItem->setBackground(QBrush(m_categoryColors.value(category)));
-        }
-
-        addItemRow(values["startDate"].toDate(), eventItem);
-    }
-}
-
-void EventModel::addTodoItem(const QMap <QString, QVariant> &values)
-{
-    QColor textColor = Plasma::Theme::defaultTheme()->color(Plasma::Theme::TextColor);
-    QMap<QString, QVariant> data = values;
-    QString category = values["mainCategory"].toString();
-
-    // dont add todos starting later than a year
-    if (values["hasDueDate"].toBool() == true && values["dueDate"].toDate() > QDate::currentDate().addDays(365)) {
+        int slot = m_occurrences.append(incidence, NormalItem, record.startDate, record.endDate);
+        addItemRow(record.startDate.date(), slot);
+    }
+}
+
+void EventModel::addTodoItem(const IncidenceRecord &record, const QList<QDateTime> &recurDates)
+{
+    // dont add todos starting later than a year, dayChanged() adds them once their day comes
+    if (record.hasDueDate && record.dueDate.date() > QDate::currentDate().addDays(365)) {
+        if (!record.recurs) // recurring ones are expanded again anyway
+            m_laterItems.insert(record.itemId, record);
         return;
     }
 
-    if (values["recurs"].toBool()) {
+    IncidencePtr incidence = createIncidence(record);
+
+    if (record.recurs) {
         int c = 0;
-        QList<QVariant> dtTimes = values["recurDates"].toList();
-        foreach (const QVariant &eventDtTime, dtTimes) {
+        foreach (const QDateTime &eventDtTime, recurDates) {
             if (recurringCount != 0 && c >= recurringCount)
                 break;
 
-            QStandardItem *todoItem = new QStandardItem();
-            data["dueDate"] = eventDtTime;
-            data["itemType"] = TodoItem;
-            todoItem->setData(QVariant(TodoItem), ItemTypeRole);
-            todoItem->setForeground(QBrush(textColor));
-            todoItem->setData(data, Qt::DisplayRole);
-            todoItem->setData(eventDtTime, SortRole);
-            todoItem->setData(values["uid"], EventModel::UIDRole);
-            todoItem->setData(values["itemid"], ItemIDRole);
-            todoItem->setData(values["collectionId"], CollectionRole);
-            todoItem->setData(values["tooltip"], TooltipRole);
-            if (values["completed"].toBool() == true) {
-                todoItem->setBackground(QBrush(finishedTodoBg));
-            } else if (m_categoryColors.contains(category)) {
-                todoItem->setBackground(QBrush(m_categoryColors.value(category)));
-            } else {
-                todoItem->setBackground(QBrush(todoBg));
-            }
-
-            addItemRow(eventDtTime.toDate(), todoItem);
+            int slot = m_occurrences.append(incidence, TodoItem, eventDtTime, QDateTime());
+            addItemRow(eventDtTime.date(), slot);
 
             ++c;
         }
     } else {
-        QStandardItem *todoItem = new QStandardItem();
-        data["itemType"] = TodoItem;
-        todoItem->setData(QVariant(TodoItem), ItemTypeRole);
-        todoItem->setForeground(QBrush(textColor));
-        todoItem->setData(data, Qt::DisplayRole);
-        todoItem->setData(values["dueDate"], SortRole);
-        todoItem->setData(values["uid"], EventModel::UIDRole);
-        todoItem->setData(values["itemid"], ItemIDRole);
-        todoItem->setData(values["collectionId"], CollectionRole);
-        todoItem->setData(values["tooltip"], TooltipRole);
-        if (values["completed"].toBool() == true) {
-            todoItem->setBackground(QBrush(finishedTodoBg));
-        } else if (m_categoryColors.contains(category)) {
-            todoItem->setBackground(QBrush(m_categoryColors.value(category)));
-        } else {
-            todoItem->setBackground(QBrush(todoBg));
-        }
-
-        addItemRow(values["dueDate"].toDate(), todoItem);
+        int slot = m_occurrences.append(incidence, TodoItem, record.dueDate, QDateTime());
+        addItemRow(record.dueDate.date(), slot);
     }
 }
 
-void EventModel::addItemRow(QDate eventDate, QStandardItem *incidenceItem)
+IncidencePtr EventModel::createIncidence(const IncidenceRecord &record)
 {
-    QStandardItem *headerItem = 0;
+    // ids are interned once per incidence, the filter only compares masks
+    IncidencePtr incidence(new IncidenceData(record));
+    incidence->collectionIndex = collectionIndex(record.collectionId);
+    foreach (const QString &category, record.categories) {
+        incidence->categoryMask.set(categoryIndex(category));
+    }
+    return incidence;
+}
 
-    foreach (QStandardItem *item, m_sectionItemsMap) {
-        if (eventDate < item->data(SortRole).toDate())
-            break;
-        else
-            headerItem = item;
+EventModel::HeaderItemData *EventModel::headerItemForDate(const QDate &eventDate)
+{
+    HeaderItemData *headerItem = 0;
+
+    const int offset = m_headerTableStart.daysTo(eventDate);
+    if (offset >= 0 && offset < m_headerTable.size()) {
+        headerItem = m_headerTable.at(offset);
+    } else { // outside of the table, fall back to the map
+        QMap<QDate, HeaderItemData *>::iterator it = m_sectionItemsMap.upperBound(eventDate);
+        if (it != m_sectionItemsMap.begin())
+            headerItem = (--it).value();
     }
 
     if (useAutoGroupHeader) {
-        if ((headerItem && eventDate >= QDate::currentDate() && eventDate > headerItem->data(SortRole).toDate()) || (headerItem == 0 && eventDate > QDate::currentDate().addDays(-29))) {
+        if ((headerItem && eventDate >= QDate::currentDate() && eventDate > headerItem->date) || (headerItem == 0 && eventDate > QDate::currentDate().addDays(-29))) {
             int days = QDate::currentDate().daysTo(eventDate);
-            QStandardItem *item = new QStandardItem();
-            initHeaderItem(item, QString("%{date}"), QString(), days);
-            m_sectionItemsMap.insert(item->data(SortRole).toDate(), item);
+            HeaderItemData *item = initHeaderItem(QString("%{date}"), QString(), days);
+            item->autoGroup = true;
+            m_sectionItemsMap.insert(item->date, item);
+            updateHeaderTable(item);
             headerItem = item;
         }
     }
 
+    return headerItem;
+}
 
-    if (headerItem) {
-        headerItem->appendRow(incidenceItem);
-        headerItem->sortChildren(0, Qt::AscendingOrder);
-        if (headerItem->row() == -1) {
-            parentItem->appendRow(headerItem);
-            parentItem->sortChildren(0, Qt::AscendingOrder);
-        }
-        
-        emit modelNeedsExpanding();
-    }
-}
-
-QMap<QString, QVariant> EventModel::eventDetails(const Akonadi::Item &item, KCalCore::Event::Ptr event)
-{
-    QMap <QString, QVariant> values;
-    Akonadi::Collection itemCollection = m_collections.value(item.storageCollectionId());
-    m_usedCollections.insert(itemCollection.name(), QString::number(itemCollection.id()));
-    values["resource"] = itemCollection.resource();
-    values["collectionName"] = itemCollection.name();
-    values["collectionId"] = QString::number(itemCollection.id());
-    values["uid"] = event->uid();
-    values["itemid"] = item.id();
-    values["remoteid"] = item.remoteId();
-    values["summary"] = event->summary();
-    values["description"] = event->description();
-    values["location"] = event->location();
-    QStringList categories = event->categories();
-    if (categories.isEmpty()) {
-        values["categories"] = i18n("Unspecified");
-        values["mainCategory"] = i18n("Unspecified");
-    } else {
-        values["categories"] = categories;
-        values["mainCategory"] = categories.first();
+void EventModel::rebuildHeaderTable()
+{
+    m_headerTableStart = QDate::currentDate().addDays(HeaderTableFirstDay);
+    m_headerTable.fill(0, HeaderTableLastDay - HeaderTableFirstDay + 1);
+
+    HeaderItemData *current = 0;
+    QMap<QDate, HeaderItemData *>::const_iterator it = m_sectionItemsMap.constBegin();
+    for (int i = 0; i < m_headerTable.size(); ++i) {
+        const QDate day = m_headerTableStart.addDays(i);
+        while (it != m_sectionItemsMap.constEnd() && it.key() <= day) {
+            current = it.value();
+            ++it;
+        }
+        m_headerTable[i] = current;
     }
+}
+
+void EventModel::updateHeaderTable(HeaderItemData *header)
+{
+    // the new header takes over the days up to the next later header
+    for (int i = qMax(0, m_headerTableStart.daysTo(header->date)); i < m_headerTable.size(); ++i) {
+        HeaderItemData *current = m_headerTable.at(i);
+        if (current && current->date >= header->date)
+            break;
+        m_headerTable[i] = header;
+    }
+}
+
+void EventModel::registerOccurrence(HeaderItemData *header, int slot)
+{
+    if (slot >= m_occurrenceHeaders.size())
+        m_occurrenceHeaders.resize(slot + 1);
+    m_occurrenceHeaders[slot] = header;
+    m_itemOccurrences[m_occurrences.itemId(slot)].append(slot);
+
+    const QDateTime now = QDateTime::currentDateTime();
+    updateOccurrenceState(slot, now);
+    scheduleTransition(slot, now);
+}
 
-    values["status"] = event->status();
-    values["startDate"] = event->dtStart().toLocalZone().dateTime();
-    values["endDate"] = event->dtEnd().toLocalZone().dateTime();
+void EventModel::unregisterOccurrence(int slot)
+{
+    QHash<Akonadi::Item::Id, QVector<int> >::iterator it = m_itemOccurrences.find(m_occurrences.itemId(slot));
+    if (it == m_itemOccurrences.end())
+        return;
 
-    bool recurs = event->recurs();
-    values["recurs"] = recurs;
-    QList<QVariant> recurDates;
-    if (recurs) {
-        KCalCore::Recurrence *r = event->recurrence();
-        KCalCore::DateTimeList dtTimes = r->timesInInterval(KDateTime(QDate::currentDate()), KDateTime(QDate::currentDate()).addDays(365));
-        dtTimes.sortUnique();
-        foreach (const KDateTime &t, dtTimes) {
-            recurDates << QVariant(t.toLocalZone().dateTime());
+    const int i = it.value().indexOf(slot);
+    if (i != -1)
+        it.value().remove(i);
+    if (it.value().isEmpty())
+        m_itemOccurrences.erase(it);
+}
+
+QDateTime EventModel::nextTransition(int slot, const QDateTime &now) const
+{
+    const QDateTime dtTime = m_occurrences.sortDateTime(slot);
+
+    switch (m_occurrences.type(slot)) {
+        case NormalItem: {
+            const QDateTime urgent = dtTime.addSecs(-urgency * 60);
+            if (now < urgent)
+                return urgent;
+            if (now <= dtTime) // passed once now is later than the start
+                return dtTime.addSecs(1);
+            break;
+        }
+        case BirthdayItem:
+        case AnniversaryItem: {
+            const QDate urgent = dtTime.date().addDays(1 - birthdayUrgency);
+            if (now.date() < urgent)
+                return QDateTime(urgent);
+            if (now.date() <= dtTime.date())
+                return QDateTime(dtTime.date().addDays(1));
+            break;
         }
+        default:
+            break;
     }
-    values["recurDates"] = recurDates;
 
-    if (event->customProperty("KABC", "BIRTHDAY") == QString("YES") || categories.contains(i18n("Birthday")) || categories.contains("Birthday")) {
-        values["isBirthday"] = QVariant(true);
-    } else {
-        values["isBirthday"] = QVariant(false);
-    }
-
-    event->customProperty("KABC", "ANNIVERSARY") == QString("YES") ? values ["isAnniversary"] = QVariant(true) : QVariant(false);
-    values["contactName"] = event->customProperty("KABC", "NAME-1");
-    values["tooltip"] = KCalUtils::IncidenceFormatter::toolTipStr(itemCollection.name(), event, event->dtStart().date(), true, KDateTime::Spec::LocalZone());
-
-    return values;
-}
-
-QMap<QString, QVariant> EventModel::todoDetails(const Akonadi::Item &item, KCalCore::Todo::Ptr todo)
-{
-    QMap <QString, QVariant> values;
-    Akonadi::Collection itemCollection = m_collections.value(item.storageCollectionId());
-    m_usedCollections.insert(itemCollection.name(), QString::number(itemCollection.id()));
-    values["resource"] = itemCollection.resource();
-    values["collectionName"] = itemCollection.name();
-    values["collectionId"] = QString::number(itemCollection.id());
-    values["uid"] = todo->uid();
-    values["itemid"] = item.id();
-    values["remoteid"] = item.remoteId();
-    values["summary"] = todo->summary();
-    values["description"] = todo->description();
-    values["location"] = todo->location();
-    QStringList categories = todo->categories();
-    if (categories.isEmpty()) {
-        values["categories"] = i18n("Unspecified");
-        values["mainCategory"] = i18n("Unspecified");
-    } else {
-        values["categories"] = categories;
-        values["mainCategory"] = categories.first();
+    return QDateTime();
+}
+
+void EventModel::scheduleTransition(int slot, const QDateTime &now)
+{
+    const QDateTime due = nextTransition(slot, now);
+    if (!due.isValid()) {
+        m_transitionSlots.remove(slot);
+        return;
     }
 
-    values["completed"] = todo->isCompleted();
-    values["percent"] = todo->percentComplete();
-    if (todo->hasStartDate()) {
-        values["startDate"] = todo->dtStart(false).toLocalZone().dateTime();
-        values["hasStartDate"] = true;
-    } else {
-        values["startDate"] = QDateTime();
-        values["hasStartDate"] = false;
-    }
-    values["completedDate"] = todo->completed().toLocalZone().dateTime();
-    values["inProgress"] = todo->isInProgress(false);
-    values["isOverdue"] = todo->isOverdue();
-    if (todo->hasDueDate()) {
-        values["dueDate"] = todo->dtDue().toLocalZone().dateTime();
-        values["hasDueDate"] = true;
+    // an older entry of the slot stays queued, it is skipped once it is due
+    m_transitionSlots.insert(slot, due);
+    m_transitions.insert(due, slot);
+    if (m_transitions.constBegin().key() == due)
+        armTransitionTimer();
+}
+
+void EventModel::rescheduleTransitions()
+{
+    m_transitions.clear();
+    m_transitionSlots.clear();
+
+    const QDateTime now = QDateTime::currentDateTime();
+    foreach (HeaderItemData *header, m_headers) {
+        foreach (int slot, header->occurrences) {
+            updateOccurrenceState(slot, now);
+            scheduleTransition(slot, now);
+        }
+    }
+    armTransitionTimer();
+}
+
+void EventModel::armTransitionTimer()
+{
+    if (m_transitions.isEmpty()) {
+        m_transitionTimer->stop();
+        return;
+    }
+
+    const qint64 delay = QDateTime::currentDateTime().msecsTo(m_transitions.constBegin().key());
+    m_transitionTimer->start(qBound<qint64>(0, delay, MaxTransitionDelay));
+}
+
+void EventModel::transitionsDue()
+{
+    const QDateTime now = QDateTime::currentDateTime();
+
+    QVector<int> due;
+    while (!m_transitions.isEmpty() && m_transitions.constBegin().key() <= now) {
+        QMultiMap<QDateTime, int>::iterator it = m_transitions.begin();
+        const int slot = it.value();
+        if (m_transitionSlots.value(slot) == it.key()) {
+            m_transitionSlots.remove(slot);
+            if (m_occurrenceHeaders.value(slot))
+                due.append(slot);
+        }
+        m_transitions.erase(it);
+    }
+
+    foreach (int slot, due) {
+        updateOccurrenceState(slot, now);
+        scheduleTransition(slot, now);
+
+        HeaderItemData *header = m_occurrenceHeaders.at(slot);
+        if (header->row != -1) {
+            const QModelIndex idx = createIndex(occurrenceRow(header, slot), 0, header);
+            emit dataChanged(idx, idx);
+        }
+    }
+
+    armTransitionTimer();
+}
+
+void EventModel::updateOccurrenceState(int slot, const QDateTime &now)
+{
+    const QDateTime dtTime = m_occurrences.sortDateTime(slot);
+    OccurrenceTable::State state = OccurrenceTable::NormalState;
+
+    switch (m_occurrences.type(slot)) {
+        // the same boundaries as in nextTransition(), a transition that is due
+        // right now must not leave the state unchanged
+        case BirthdayItem:
+        case AnniversaryItem:
+            if (dtTime.date() >= now.date() && now.date() >= dtTime.date().addDays(1 - birthdayUrgency))
+                state = OccurrenceTable::UrgentState;
+            break;
+        case NormalItem:
+            if (now > dtTime) {
+                state = OccurrenceTable::PassedState;
+            } else if (now >= dtTime.addSecs(-urgency * 60)) {
+                state = OccurrenceTable::UrgentState;
+            }
+            break;
+        default:
+            break;
+    }
+
+    m_occurrences.setState(slot, state);
+}
+
+QColor EventModel::occurrenceBackground(int slot) const
+{
+    const int type = m_occurrences.type(slot);
+    const QString category = m_occurrences.mainCategory(slot);
+
+    if (type == TodoItem) {
+        if (m_occurrences.isCompleted(slot))
+            return finishedTodoBg;
+        return m_categoryColors.value(category, todoBg);
+    }
+
+    switch (m_occurrences.state(slot)) {
+        case OccurrenceTable::UrgentState:
+            return urgentBg;
+        case OccurrenceTable::PassedState:
+            return QColor();
+        default:
+            break;
+    }
+
+    if (type == BirthdayItem && !m_categoryColors.contains(category)) {
+        if (m_categoryColors.contains(i18n("Birthday")))
+            return m_categoryColors.value(i18n("Birthday"));
+        return m_categoryColors.value("Birthday");
+    }
+
+    return m_categoryColors.value(category);
+}
+
+QColor EventModel::occurrenceForeground(int slot) const
+{
+    if (m_occurrences.state(slot) == OccurrenceTable::PassedState)
+        return passedFg;
+
+    return Plasma::Theme::defaultTheme()->color(Plasma::Theme::TextColor);
+}
+
+void EventModel::addItemRow(QDate eventDate, int slot)
+{
+    if (m_bulkInsert) {
+        m_pendingOccurrences.append(slot);
+        return;
+    }
+
+    HeaderItemData *headerItem = headerItemForDate(eventDate);
+
+    if (headerItem) {
+        registerOccurrence(headerItem, slot);
+
+        // insert behind the occurrences with the same start, the header stays sorted
+        const QVector<int> &occurrences = headerItem->occurrences;
+        const int row = qUpperBound(occurrences.constBegin(), occurrences.constEnd(), slot, OccurrenceLessThan(m_occurrences)) - occurrences.constBegin();
+        if (headerItem->row == -1) {
+            headerItem->occurrences.insert(row, slot);
+            insertHeaderRow(headerItem);
+        } else {
+            beginInsertRows(createIndex(headerItem->row, 0), row, row);
+            headerItem->occurrences.insert(row, slot);
+            endInsertRows();
+        }
     } else {
-        values["dueDate"] = QDateTime::currentDateTime().addDays(366);
-        values["hasDueDate"] = false;
+        m_occurrences.remove(slot);
     }
+}
 
-    bool recurs = todo->recurs();
-    values["recurs"] = recurs;
-    QList<QVariant> recurDates;
-    if (recurs) {
-        KCalCore::Recurrence *r = todo->recurrence();
-        KCalCore::DateTimeList dtTimes = r->timesInInterval(KDateTime(QDate::currentDate()), KDateTime(QDate::currentDate()).addDays(365));
-        dtTimes.sortUnique();
-        foreach (const KDateTime &t, dtTimes) {
-            recurDates << QVariant(t.toLocalZone().dateTime());
+void EventModel::insertPendingOccurrences()
+{
+    // bucket by header date, the map keeps the buckets in header order
+    QMap<QDate, QVector<int> > buckets;
+    foreach (int slot, m_pendingOccurrences) {
+        HeaderItemData *headerItem = headerItemForDate(m_occurrences.sortDateTime(slot).date());
+        if (!headerItem) {
+            m_occurrences.remove(slot);
+            continue;
         }
+
+        registerOccurrence(headerItem, slot);
+        buckets[headerItem->date].append(slot);
     }
-    values["recurDates"] = recurDates;
+    m_pendingOccurrences.clear();
+
+    QMap<QDate, QVector<int> >::iterator it;
+    for (it = buckets.begin(); it != buckets.end(); ++it) {
+        HeaderItemData *headerItem = m_sectionItemsMap.value(it.key());
+        QVector<int> &bucket = it.value();
+        qStableSort(bucket.begin(), bucket.end(), OccurrenceLessThan(m_occurrences));
+
+        if (headerItem->row == -1) {
+            const int first = headerItem->occurrences.count();
+            const bool interleaved = first > 0 && m_occurrences.sortKey(bucket.first()) < m_occurrences.sortKey(headerItem->occurrences.last());
+            headerItem->occurrences += bucket;
+            if (interleaved)
+                sortHeader(headerItem, first);
+            insertHeaderRow(headerItem);
+        } else {
+            insertOccurrenceRuns(headerItem, bucket);
+        }
+    }
+}
+
+void EventModel::insertOccurrenceRuns(HeaderItemData *header, const QVector<int> &sorted)
+{
+    // every run of new occurrences that goes between the same two rows is one
+    // plain row insert, the views and the proxy never have to relayout
+    OccurrenceLessThan lessThan(m_occurrences);
+    QVector<int> &occurrences = header->occurrences;
+    const QModelIndex parent = createIndex(header->row, 0);
+
+    int i = 0;
+    while (i < sorted.count()) {
+        const int row = qUpperBound(occurrences.constBegin(), occurrences.constEnd(), sorted.at(i), lessThan) - occurrences.constBegin();
+        int j = i + 1;
+        if (row < occurrences.count()) {
+            while (j < sorted.count() && lessThan(sorted.at(j), occurrences.at(row)))
+                ++j;
+        } else {
+            j = sorted.count();
+        }
 
-    values["tooltip"] = KCalUtils::IncidenceFormatter::toolTipStr(itemCollection.name(), todo, todo->dtStart().date(), true, KDateTime::Spec::LocalZone());
+        beginInsertRows(parent, row, row + j - i - 1);
+        occurrences.insert(row, j - i, -1);
+        for (int k = i; k < j; ++k) {
+            occurrences[row + k - i] = sorted.at(k);
+        }
+        endInsertRows();
+
+        i = j;
+    }
+}
+
+QString EventModel::tooltip(Akonadi::Item::Id id, int revision) const
+{
+    const QString *cached = m_tooltips.object(qMakePair(id, revision));
+    if (cached)
+        return *cached;
+
+    // tooltips are built on the first hover, the rows are updated when the item arrives
+    if (!m_pendingTooltips.contains(id)) {
+        m_pendingTooltips.insert(id);
+        Akonadi::ItemFetchJob *job = new Akonadi::ItemFetchJob(Akonadi::Item(id));
+        job->fetchScope().fetchFullPayload();
+        job->setProperty("itemId", id);
+        job->setProperty("revision", revision);
+        connect(job, SIGNAL(result(KJob *)), this, SLOT(tooltipFetchFinished(KJob *)));
+        job->start();
+    }
 
-    return values;
+    return QString();
+}
+
+void EventModel::tooltipFetchFinished(KJob *job)
+{
+    const Akonadi::Item::Id id = job->property("itemId").toLongLong();
+    m_pendingTooltips.remove(id);
+    if (job->error()) {
+        kDebug() << "Tooltip item fetch failed!";
+        return;
+    }
+
+    Akonadi::ItemFetchJob *iJob = qobject_cast<Akonadi::ItemFetchJob *>(job);
+    foreach (const Akonadi::Item &item, iJob->items()) {
+        if (!item.hasPayload<KCalCore::Incidence::Ptr>())
+            continue;
+
+        KCalCore::Incidence::Ptr incidence = item.payload<KCalCore::Incidence::Ptr>();
+        const QString collectionName = m_collections.value(item.storageCollectionId()).name();
+        QString *tip = new QString(KCalUtils::IncidenceFormatter::toolTipStr(collectionName, incidence, incidence->dtStart().date(), true, KDateTime::Spec::LocalZone()));
+        // cached under the revision the rows ask for, a newer one arrives with the monitor
+        m_tooltips.insert(qMakePair(id, job->property("revision").toInt()), tip, tip->length());
+
+        foreach (int slot, m_itemOccurrences.value(item.id())) {
+            HeaderItemData *header = m_occurrenceHeaders.at(slot);
+            if (header->row != -1) {
+                const QModelIndex idx = createIndex(occurrenceRow(header, slot), 0, header);
+                emit dataChanged(idx, idx);
+            }
+        }
+    }
+}
+
+int EventModel::expansionDays() const
+{
+    return qBound(0, m_period, 365);
 }
 
 QMap<QString, QString> EventModel::usedCollections()
@@ -27,14 +27,26 @@
 
 #include <KUrl>
 
+#include "eventsnapshot.h"
+#include "incidencedecoder.h"
+#include "incidencerecord.h"
+#include "occurrencetable.h"
+#include "recurrencecache.h"
+
 // qt headers
-#include <QStandardItemModel>
+#include <QAbstractItemModel>
+#include <QCache>
+#include <QPair>
+#include <QSet>
 #include <QColor>
+#include <QFutureWatcher>
 #include <QHash>
 #include <QString>
+#include <QTime>
+#include <QVector>
 
-class QStandardItem;
 class KJob;
+class QTimer;
 
 static const int ShortDateFormat = 0;
 static const int LongDateFormat = 1;
@@ -50,8 +62,9 @@ static const int finishedTodoColorPos = 3;
 /**
 * Model of the view
 * Categorizes the events using the startDate property
+* Top level rows are the headers, their children the occurrences
 */
-class EventModel : public QStandardItemModel
+class EventModel : public QAbstractItemModel
 {
     Q_OBJECT
 public:
@@ -61,7 +74,12 @@ public:
         ItemTypeRole,
         TooltipRole,
         ItemIDRole,
-        CollectionRole
+        CollectionRole,
+        RecordRole,
+        CategoriesRole,
+        MainCategoryRole,
+        CompletedRole,
+        EndDateRole
     };
 
     enum ItemType {
@@ -72,52 +90,163 @@ public:
         TodoItem
     };
 
+    /**
+    * What EventFilterModel needs to know of a row, without going through QVariant
+    * Days are julian days, 0 if there is no date. Collections and categories
+    * are interned, see collectionMask() and categoryMask(). The header identifies
+    * the header row itself or the header of an occurrence, the slot identifies
+    * an occurrence as long as it is in the model, -1 for header rows.
+    */
+    struct FilterKey {
+        const void *header;
+        int slot;
+        int type;
+        int day;
+        int endDay;
+        bool completed;
+        int collectionIndex;
+        const FilterMask *categories;
+    };
+
     explicit EventModel(QObject *parent = 0, int urgencyTime = 15, int birthdayTime = 14, QList<QColor> colorList = QList<QColor>(), int count = 0, bool autoGroupHeader = false);
     ~EventModel();
 
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    QModelIndex parent(const QModelIndex &child) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+    FilterKey filterKey(const QModelIndex &index) const;
+    FilterMask collectionMask(const QStringList &collections);
+    FilterMask categoryMask(const QStringList &categories);
+
 public:
     void setDateFormat(int format, QString string);
     void setCategoryColors(const QHash<QString, QColor>);
+    void refreshColors();
+    void rowsChanged(const QModelIndex &parent, int first, int last);
     void setHeaderItems(QStringList headerParts);
+    void setPeriod(int period);
+    void setExcludedCollections(const QStringList &collections);
     void initModel();
+    void loadSnapshot();
     void initMonitor();
     void resetModel();
+    void dayChanged();
+    void resourceOnline(const QString &resource);
     void settingsChanged(int urgencyTime, int birthdayTime, QList<QColor> itemColors, int count, bool autoGroupHeader);
     QMap<QString, QString> usedCollections();
 
 private slots:
     void initialCollectionFetchFinished(KJob *);
     void initialItemFetchFinished(KJob *);
-    void addEventItem(const QMap <QString, QVariant> &values);
-    void addTodoItem(const QMap <QString, QVariant> &values);
     void itemAdded(const Akonadi::Item &, const Akonadi::Collection &);
     void removeItem(const Akonadi::Item &);
     void itemChanged(const Akonadi::Item &, const QSet<QByteArray> &);
     void itemMoved(const Akonadi::Item &, const Akonadi::Collection &, const Akonadi::Collection &);
+    void collectionAdded(const Akonadi::Collection &, const Akonadi::Collection &);
+    void tooltipFetchFinished(KJob *);
+    void saveSnapshot();
+    void decodedItemsReady(int begin, int end);
+    void decodingFinished();
+    void transitionsDue();
 
 private:
+    struct HeaderItemData {
+        QString title;
+        QString toolTip;
+        QDate date;
+        int row;
+        bool autoGroup;
+        QVector<int> occurrences;
+    };
+
+    void clearModel();
     void createHeaderItems(QStringList headerParts);
-    void initHeaderItem(QStandardItem *item, QString title, QString toolTip, int days);
+    HeaderItemData *initHeaderItem(QString title, QString toolTip, int days);
+    void insertHeaderRow(HeaderItemData *header);
+    void removeHeaderRow(HeaderItemData *header);
+    void removeOccurrences(const QVector<int> &occurrences, bool release = true);
+    void removeOccurrenceRows(HeaderItemData *header, int first, int last, bool release = true);
+    void sortHeader(HeaderItemData *header, int sortedCount = 0);
+    int occurrenceRow(HeaderItemData *header, int slot) const;
     void addItem(const Akonadi::Item &item, const Akonadi::Collection &collection);
-    void addItemRow(QDate eventDate, QStandardItem *items);
-    QMap<QString, QVariant> eventDetails(const Akonadi::Item &, KCalCore::Event::Ptr);
-    QMap<QString, QVariant> todoDetails(const Akonadi::Item &, KCalCore::Todo::Ptr);
+    void addDecodedItem(const DecodedItem &decoded);
+    void updateItem(const Akonadi::Item &item);
+    void updateDecodedItem(const DecodedItem &decoded);
+    bool isUnchanged(const DecodedItem &decoded) const;
+    IncidenceDecoder decoder();
+    void cancelDecoding();
+    void addEventItem(const IncidenceRecord &record, const QList<QDateTime> &recurDates);
+    void addTodoItem(const IncidenceRecord &record, const QList<QDateTime> &recurDates);
+    IncidencePtr createIncidence(const IncidenceRecord &record);
+    int collectionIndex(Akonadi::Entity::Id id);
+    int categoryIndex(const QString &category);
+    HeaderItemData *headerItemForDate(const QDate &eventDate);
+    void rebuildHeaderTable();
+    void updateHeaderTable(HeaderItemData *header);
+    void registerOccurrence(HeaderItemData *header, int slot);
+    void unregisterOccurrence(int slot);
+    void addItemRow(QDate eventDate, int slot);
+    void insertPendingOccurrences();
+    void insertOccurrenceRuns(HeaderItemData *header, const QVector<int> &sorted);
+    void startQueuedFetches();
+    void updateMonitoredCollections();
+    void initialFetchDone();
+    void scheduleSnapshot();
+    QDateTime nextTransition(int slot, const QDateTime &now) const;
+    void scheduleTransition(int slot, const QDateTime &now);
+    void rescheduleTransitions();
+    void armTransitionTimer();
+    void updateOccurrenceState(int slot, const QDateTime &now);
+    QColor occurrenceBackground(int slot) const;
+    QColor occurrenceForeground(int slot) const;
+    QString tooltip(Akonadi::Item::Id id, int revision) const;
+    int expansionDays() const;
 
 private:
-    QStandardItem *parentItem;
+    QList<HeaderItemData *> m_headers;
+    OccurrenceTable m_occurrences;
     QStringList m_headerPartsList;
-    QMap<QDate, QStandardItem *> m_sectionItemsMap;
+    QMap<QDate, HeaderItemData *> m_sectionItemsMap;
+    QVector<HeaderItemData *> m_headerTable;
+    QDate m_headerTableStart;
     QMap<QString, QString> m_usedCollections;
     int urgency, birthdayUrgency, recurringCount;
     QColor urgentBg, passedFg, todoBg, finishedTodoBg;
     QHash<QString, QColor> m_categoryColors;
     QHash<Akonadi::Entity::Id, Akonadi::Collection> m_collections;
-    QList<Akonadi::Entity::Id> itemIds;
+    QHash<Akonadi::Item::Id, QVector<int> > m_itemOccurrences;
+    QVector<HeaderItemData *> m_occurrenceHeaders;
+    QVector<int> m_pendingOccurrences;
+    QHash<Akonadi::Item::Id, Akonadi::Item> m_recurringItems;
+    QHash<Akonadi::Item::Id, IncidenceRecord> m_laterItems;
+    RecurrenceCache m_recurrenceCache;
+    QSet<QFutureWatcher<DecodedItem> *> m_decodeWatchers;
+    EventSnapshot m_snapshot;
+    QTimer *m_snapshotTimer;
+    QHash<Akonadi::Item::Id, Akonadi::Entity::Id> m_snapshotItems;
+    QSet<Akonadi::Entity::Id> m_failedCollections;
+    QList<Akonadi::Collection> m_fetchQueue;
+    QHash<KJob *, QTime> m_fetchTimes;
+    QHash<Akonadi::Entity::Id, int> m_collectionPriority;
+    QSet<Akonadi::Entity::Id> m_excludedCollections;
+    QHash<Akonadi::Entity::Id, int> m_collectionIndexes;
+    QHash<QString, int> m_categoryIndexes;
+    QMultiMap<QDateTime, int> m_transitions;
+    QHash<int, QDateTime> m_transitionSlots;
+    QTimer *m_transitionTimer;
+    int m_pendingFetches;
+    bool m_fetching;
+    mutable QCache<QPair<Akonadi::Item::Id, int>, QString> m_tooltips;
+    mutable QSet<Akonadi::Item::Id> m_pendingTooltips;
     Akonadi::Monitor *m_monitor;
+    Akonadi::Monitor *m_collectionMonitor;
+    int m_period;
     bool useAutoGroupHeader;
-
-signals:
-    void modelNeedsExpanding();
+    bool m_bulkInsert;
 };
 
 #endif
@@ -0,0 +1,150 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *   Copyright (C) 2012 by gerdfleischer <gerdfleischer@web.de>
+ */
+
+#include "eventsnapshot.h"
+
+// qt headers
+#include <QByteArray>
+#include <QDataStream>
+#include <QFile>
+
+// kde headers
+#include <KSaveFile>
+#include <KStandardDirs>
+
+#include <KDebug>
+
+static const quint32 SnapshotMagic = 0x45564c53; // "EVLS"
+static const quint32 SnapshotVersion = 1;
+
+static QDataStream &operator<<(QDataStream &stream, const IncidenceRecord &record)
+{
+    quint16 flags = 0;
+    flags |= record.recurs ? 0x01 : 0;
+    flags |= record.isBirthday ? 0x02 : 0;
+    flags |= record.isAnniversary ? 0x04 : 0;
+    flags |= record.completed ? 0x08 : 0;
+    flags |= record.hasStartDate ? 0x10 : 0;
+    flags |= record.hasDueDate ? 0x20 : 0;
+    flags |= record.inProgress ? 0x40 : 0;
+    flags |= record.isOverdue ? 0x80 : 0;
+
+    stream << qint8(record.itemType) << flags << qint64(record.itemId) << qint32(record.revision) << qint64(record.collectionId);
+    stream << record.resource << record.collectionName << record.uid << record.remoteId;
+    stream << record.summary << record.description << record.location;
+    stream << record.mainCategory << record.categories << record.contactName;
+    stream << record.startDate << record.endDate << record.dueDate << record.completedDate;
+    stream << qint8(record.status) << qint8(record.percent);
+
+    return stream;
+}
+
+static QDataStream &operator>>(QDataStream &stream, IncidenceRecord &record)
+{
+    qint8 itemType, status, percent;
+    quint16 flags;
+    qint64 itemId, collectionId;
+    qint32 revision;
+
+    stream >> itemType >> flags >> itemId >> revision >> collectionId;
+    stream >> record.resource >> record.collectionName >> record.uid >> record.remoteId;
+    stream >> record.summary >> record.description >> record.location;
+    stream >> record.mainCategory >> record.categories >> record.contactName;
+    stream >> record.startDate >> record.endDate >> record.dueDate >> record.completedDate;
+    stream >> status >> percent;
+
+    record.itemType = itemType;
+    record.itemId = itemId;
+    record.revision = revision;
+    record.collectionId = collectionId;
+    record.status = status;
+    record.percent = percent;
+    record.recurs = flags & 0x01;
+    record.isBirthday = flags & 0x02;
+    record.isAnniversary = flags & 0x04;
+    record.completed = flags & 0x08;
+    record.hasStartDate = flags & 0x10;
+    record.hasDueDate = flags & 0x20;
+    record.inProgress = flags & 0x40;
+    record.isOverdue = flags & 0x80;
+
+    return stream;
+}
+
+QString EventSnapshot::fileName() const
+{
+    return KStandardDirs::locateLocal("data", "plasma-applet-events/events.snapshot");
+}
+
+QList<EventSnapshot::Entry> EventSnapshot::load() const
+{
+    QList<Entry> entries;
+
+    QFile file(fileName());
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0)
+        return entries;
+
+    // read straight from the mapped file instead of copying it into memory first
+    uchar *data = file.map(0, file.size());
+    QByteArray mapped;
+    if (data) {
+        mapped = QByteArray::fromRawData(reinterpret_cast<const char *>(data), file.size());
+    } else {
+        mapped = file.readAll();
+    }
+
+    QDataStream stream(mapped);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    quint32 magic, version, count;
+    stream >> magic >> version >> count;
+    if (magic != SnapshotMagic || version != SnapshotVersion) {
+        kDebug() << "Ignoring event snapshot with unknown format";
+        return entries;
+    }
+
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        Entry entry;
+        stream >> entry.record >> entry.recurDates;
+        entries.append(entry);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        kDebug() << "Event snapshot is corrupt, dropping it";
+        entries.clear();
+    }
+
+    return entries;
+}
+
+void EventSnapshot::save(const QList<Entry> &entries) const
+{
+    KSaveFile file(fileName());
+    if (!file.open(QIODevice::WriteOnly)) {
+        kDebug() << "Could not write event snapshot" << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << SnapshotMagic << SnapshotVersion << quint32(entries.count());
+    foreach (const Entry &entry, entries) {
+        stream << entry.record << entry.recurDates;
+    }
+
+    file.finalize();
+}
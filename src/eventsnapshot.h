@@ -0,0 +1,46 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *   Copyright (C) 2012 by gerdfleischer <gerdfleischer@web.de>
+ */
+
+#ifndef EVENTSNAPSHOT_H
+#define EVENTSNAPSHOT_H
+
+#include "incidencerecord.h"
+
+// qt headers
+#include <QDateTime>
+#include <QList>
+
+/**
+* Snapshot of the incidences shown last time
+* It is shown at startup until the items are fetched from Akonadi.
+*/
+class EventSnapshot
+{
+public:
+    struct Entry {
+        IncidenceRecord record;
+        QList<QDateTime> recurDates;
+    };
+
+    QList<Entry> load() const;
+    void save(const QList<Entry> &entries) const;
+
+private:
+    QString fileName() const;
+};
+
+#endif
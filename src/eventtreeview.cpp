@@ -20,10 +20,17 @@
 
 #include <QModelIndex>
 #include <QMouseEvent>
+#include <QTimer>
 
 EventTreeView::EventTreeView(QWidget* parent)
     : QTreeView(parent)
 {
+    // expand new headers once per event loop turn, not per inserted row
+    m_expandTimer = new QTimer(this);
+    m_expandTimer->setSingleShot(true);
+    m_expandTimer->setInterval(0);
+    connect(m_expandTimer, SIGNAL(timeout()), this, SLOT(expandNewHeaders()));
+
     setAttribute(Qt::WA_NoSystemBackground);
     setAutoFillBackground(false);
     setMouseTracking(true);
@@ -72,6 +79,47 @@ void EventTreeView::mousePressEvent(QMouseEvent *event)
         emit tooltipUpdated(tip);
 }
 
+void EventTreeView::rowsInserted(const QModelIndex &parent, int start, int end)
+{
+    QTreeView::rowsInserted(parent, start, end);
+
+    if (parent.isValid())
+        return;
+
+    for (int row = start; row <= end; ++row) {
+        m_newHeaders.append(QPersistentModelIndex(model()->index(row, 0)));
+    }
+
+    if (!m_expandTimer->isActive())
+        m_expandTimer->start();
+}
+
+void EventTreeView::dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    QTreeView::dataChanged(topLeft, bottomRight);
+
+    // a tooltip that was requested on hover may arrive later
+    if (!idx.isValid() || idx.parent() != topLeft.parent())
+        return;
+    if (idx.row() < topLeft.row() || idx.row() > bottomRight.row())
+        return;
+
+    QString oldTip = tip;
+    tip = idx.data(EventModel::TooltipRole).toString();
+    if (tip != oldTip)
+        emit tooltipUpdated(tip);
+}
+
+void EventTreeView::expandNewHeaders()
+{
+    foreach (const QPersistentModelIndex &header, m_newHeaders) {
+        if (header.isValid())
+            expand(header);
+    }
+
+    m_newHeaders.clear();
+}
+
 QModelIndex EventTreeView::indexAtCursor()
 {
     return idx;
@@ -79,9 +127,7 @@ QModelIndex EventTreeView::indexAtCursor()
 
 QString EventTreeView::summaryAtCursor()
 {
-    const QVariant v = idx.data(Qt::DisplayRole);
-    QMap<QString, QVariant> values = v.toMap();
-    return values["summary"].toString();
+    return idx.data(EventModel::RecordRole).value<IncidenceRecord>().summary;
 }
 
 #include "eventtreeview.moc"
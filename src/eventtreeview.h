@@ -19,9 +19,11 @@
 #define EVENTTREEVIEW_H
 
 #include <QTreeView>
+#include <QPersistentModelIndex>
 
 class QModelIndex;
 class QMouseEvent;
+class QTimer;
 
 class EventTreeView : public QTreeView
 {
@@ -38,12 +40,21 @@ protected:
     void mouseMoveEvent(QMouseEvent *event);
     void mousePressEvent(QMouseEvent *event);
 
+protected slots:
+    void rowsInserted(const QModelIndex &parent, int start, int end);
+    void dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+
+private slots:
+    void expandNewHeaders();
+
 signals:
     void tooltipUpdated(QString);
 
 private:
     QString tip;
-    QModelIndex idx;
+    QPersistentModelIndex idx;
+    QList<QPersistentModelIndex> m_newHeaders;
+    QTimer *m_expandTimer;
 };
 
 #endif
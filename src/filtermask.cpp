@@ -0,0 +1,51 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *   Copyright (C) 2012 by gerdfleischer <gerdfleischer@web.de>
+ */
+
+#include "filtermask.h"
+
+static const int BitsPerWord = 64;
+
+void FilterMask::set(int id)
+{
+    const int word = id / BitsPerWord;
+    if (word >= m_words.size())
+        m_words.resize(word + 1);
+    m_words[word] |= quint64(1) << (id % BitsPerWord);
+}
+
+bool FilterMask::test(int id) const
+{
+    const int word = id / BitsPerWord;
+    if (id < 0 || word >= m_words.size())
+        return false;
+    return m_words.at(word) & (quint64(1) << (id % BitsPerWord));
+}
+
+bool FilterMask::isSubsetOf(const FilterMask &other) const
+{
+    for (int i = 0; i < m_words.size(); ++i) {
+        const quint64 otherWord = i < other.m_words.size() ? other.m_words.at(i) : 0;
+        if (m_words.at(i) & ~otherWord)
+            return false;
+    }
+    return true;
+}
+
+void FilterMask::clear()
+{
+    m_words.clear();
+}
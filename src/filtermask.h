@@ -0,0 +1,41 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *   Copyright (C) 2012 by gerdfleischer <gerdfleischer@web.de>
+ */
+
+#ifndef FILTERMASK_H
+#define FILTERMASK_H
+
+// qt headers
+#include <QVector>
+
+/**
+* Set of small integer ids, e.g. interned categories or collections
+* Sets of a few dozen ids fit into one or two words, so testing and
+* comparing them takes constant time in practice.
+*/
+class FilterMask
+{
+public:
+    void set(int id);
+    bool test(int id) const;
+    bool isSubsetOf(const FilterMask &other) const;
+    void clear();
+
+private:
+    QVector<quint64> m_words;
+};
+
+#endif
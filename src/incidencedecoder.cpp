@@ -0,0 +1,192 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *   Copyright (C) 2012 by gerdfleischer <gerdfleischer@web.de>
+ */
+
+#include "incidencedecoder.h"
+#include "eventmodel.h"
+
+#include <kcalcore/recurrence.h>
+
+#include <KLocale>
+#include <KDateTime>
+
+// days a recurrence is expanded beyond the needed window for the cache
+static const int RecurrenceCacheMarginDays = 7;
+
+IncidenceDecoder::IncidenceDecoder(const QHash<Akonadi::Entity::Id, Akonadi::Collection> &collections, RecurrenceCache *cache, int days, int recurringCount)
+    : m_collections(collections),
+    m_cache(cache),
+    m_days(days),
+    m_recurringCount(recurringCount)
+{
+}
+
+DecodedItem IncidenceDecoder::operator()(const Akonadi::Item &item) const
+{
+    DecodedItem decoded;
+    decoded.item = item;
+    decoded.valid = false;
+
+    if (item.hasPayload<KCalCore::Event::Ptr>()) {
+        KCalCore::Event::Ptr event = item.payload<KCalCore::Event::Ptr>();
+        if (event) {
+            decoded.record = eventDetails(item, event, &decoded.recurDates);
+            decoded.valid = true;
+        }
+    } else if (item.hasPayload<KCalCore::Todo::Ptr>()) {
+        KCalCore::Todo::Ptr todo = item.payload<KCalCore::Todo::Ptr>();
+        if (todo) {
+            decoded.record = todoDetails(item, todo, &decoded.recurDates);
+            decoded.valid = true;
+        }
+    }
+
+    return decoded;
+}
+
+QList<QDateTime> IncidenceDecoder::recurrenceDates(const Akonadi::Item &item, KCalCore::Incidence::Ptr incidence) const
+{
+    const QDate today = QDate::currentDate();
+    const QDate lastDay = today.addDays(m_days);
+    QList<QDateTime> dtTimes;
+
+    if (!m_cache->lookup(item.id(), item.revision(), today, lastDay, m_recurringCount, &dtTimes)) {
+        // expand a few days more than needed, so the cache entry survives the next day changes
+        const QDate marginDay = today.addDays(RecurrenceCacheMarginDays);
+        const QDate expandUntil = lastDay.addDays(RecurrenceCacheMarginDays);
+        QDate coveredUntil = expandUntil;
+        QList<QDateTime> expanded;
+        KCalCore::Recurrence *r = incidence->recurrence();
+
+        if (m_recurringCount != 0) {
+            // only the first few occurrences are shown, dont expand the whole period
+            int counted = 0;
+            KDateTime t = r->getNextDateTime(KDateTime(today, QTime(0, 0)).addSecs(-1));
+            while (t.isValid()) {
+                const QDateTime dtTime = t.toLocalZone().dateTime();
+                if (dtTime.date() > expandUntil)
+                    break;
+                if (counted >= m_recurringCount) {
+                    coveredUntil = dtTime.date().addDays(-1);
+                    break;
+                }
+                expanded << dtTime;
+                if (dtTime.date() >= marginDay)
+                    ++counted;
+                t = r->getNextDateTime(t);
+            }
+        } else {
+            KCalCore::DateTimeList times = r->timesInInterval(KDateTime(today), KDateTime(expandUntil));
+            times.sortUnique();
+            foreach (const KDateTime &t, times) {
+                expanded << t.toLocalZone().dateTime();
+            }
+        }
+
+        m_cache->insert(item.id(), item.revision(), today, coveredUntil, expanded);
+        m_cache->lookup(item.id(), item.revision(), today, lastDay, m_recurringCount, &dtTimes);
+    }
+
+    return dtTimes;
+}
+
+IncidenceRecord IncidenceDecoder::eventDetails(const Akonadi::Item &item, KCalCore::Event::Ptr event, QList<QDateTime> *recurDates) const
+{
+    IncidenceRecord record;
+    Akonadi::Collection itemCollection = m_collections.value(item.storageCollectionId());
+    record.itemType = EventModel::NormalItem;
+    record.resource = itemCollection.resource();
+    record.collectionName = itemCollection.name();
+    record.collectionId = itemCollection.id();
+    record.uid = event->uid();
+    record.itemId = item.id();
+    record.revision = item.revision();
+    record.remoteId = item.remoteId();
+    record.summary = event->summary();
+    record.description = event->description();
+    record.location = event->location();
+    QStringList categories = event->categories();
+    if (categories.isEmpty()) {
+        record.categories = QStringList(i18n("Unspecified"));
+        record.mainCategory = i18n("Unspecified");
+    } else {
+        record.categories = categories;
+        record.mainCategory = categories.first();
+    }
+
+    record.status = event->status();
+    record.startDate = event->dtStart().toLocalZone().dateTime();
+    record.endDate = event->dtEnd().toLocalZone().dateTime();
+
+    record.recurs = event->recurs();
+    if (record.recurs) {
+        *recurDates = recurrenceDates(item, event);
+    }
+
+    record.isBirthday = event->customProperty("KABC", "BIRTHDAY") == QString("YES") || categories.contains(i18n("Birthday")) || categories.contains("Birthday");
+    record.isAnniversary = event->customProperty("KABC", "ANNIVERSARY") == QString("YES");
+    record.contactName = event->customProperty("KABC", "NAME-1");
+    return record;
+}
+
+IncidenceRecord IncidenceDecoder::todoDetails(const Akonadi::Item &item, KCalCore::Todo::Ptr todo, QList<QDateTime> *recurDates) const
+{
+    IncidenceRecord record;
+    Akonadi::Collection itemCollection = m_collections.value(item.storageCollectionId());
+    record.itemType = EventModel::TodoItem;
+    record.resource = itemCollection.resource();
+    record.collectionName = itemCollection.name();
+    record.collectionId = itemCollection.id();
+    record.uid = todo->uid();
+    record.itemId = item.id();
+    record.revision = item.revision();
+    record.remoteId = item.remoteId();
+    record.summary = todo->summary();
+    record.description = todo->description();
+    record.location = todo->location();
+    QStringList categories = todo->categories();
+    if (categories.isEmpty()) {
+        record.categories = QStringList(i18n("Unspecified"));
+        record.mainCategory = i18n("Unspecified");
+    } else {
+        record.categories = categories;
+        record.mainCategory = categories.first();
+    }
+
+    record.completed = todo->isCompleted();
+    record.percent = todo->percentComplete();
+    if (todo->hasStartDate()) {
+        record.startDate = todo->dtStart(false).toLocalZone().dateTime();
+        record.hasStartDate = true;
+    }
+    record.completedDate = todo->completed().toLocalZone().dateTime();
+    record.inProgress = todo->isInProgress(false);
+    record.isOverdue = todo->isOverdue();
+    if (todo->hasDueDate()) {
+        record.dueDate = todo->dtDue().toLocalZone().dateTime();
+        record.hasDueDate = true;
+    } else {
+        // midnight, so that decoding it again yields the same sort key
+        record.dueDate = QDateTime(QDate::currentDate().addDays(366));
+    }
+
+    record.recurs = todo->recurs();
+    if (record.recurs) {
+        *recurDates = recurrenceDates(item, todo);
+    }
+
+    return record;
+}
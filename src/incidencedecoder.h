@@ -0,0 +1,69 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *   Copyright (C) 2012 by gerdfleischer <gerdfleischer@web.de>
+ */
+
+#ifndef INCIDENCEDECODER_H
+#define INCIDENCEDECODER_H
+
+#include "incidencerecord.h"
+#include "recurrencecache.h"
+
+#include <akonadi/collection.h>
+#include <akonadi/item.h>
+
+#include <kcalcore/event.h>
+#include <kcalcore/todo.h>
+
+// qt headers
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+
+/**
+* Incidence of an item together with the dates it occurs on
+*/
+struct DecodedItem {
+    Akonadi::Item item;
+    bool valid;
+    IncidenceRecord record;
+    QList<QDateTime> recurDates;
+};
+
+/**
+* Turns the payload of an item into a record and expands its recurrence
+* It does not touch the model, so it can run in the global thread pool.
+*/
+class IncidenceDecoder
+{
+public:
+    typedef DecodedItem result_type;
+
+    IncidenceDecoder(const QHash<Akonadi::Entity::Id, Akonadi::Collection> &collections, RecurrenceCache *cache, int days, int recurringCount);
+
+    DecodedItem operator()(const Akonadi::Item &item) const;
+
+private:
+    QList<QDateTime> recurrenceDates(const Akonadi::Item &item, KCalCore::Incidence::Ptr incidence) const;
+    IncidenceRecord eventDetails(const Akonadi::Item &, KCalCore::Event::Ptr, QList<QDateTime> *recurDates) const;
+    IncidenceRecord todoDetails(const Akonadi::Item &, KCalCore::Todo::Ptr, QList<QDateTime> *recurDates) const;
+
+    QHash<Akonadi::Entity::Id, Akonadi::Collection> m_collections;
+    RecurrenceCache *m_cache;
+    int m_days;
+    int m_recurringCount;
+};
+
+#endif
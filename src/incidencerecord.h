@@ -0,0 +1,99 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *   Copyright (C) 2012 by gerdfleischer <gerdfleischer@web.de>
+ */
+
+#ifndef INCIDENCERECORD_H
+#define INCIDENCERECORD_H
+
+#include "filtermask.h"
+
+#include <akonadi/item.h>
+
+// qt headers
+#include <QDateTime>
+#include <QMetaType>
+#include <QSharedData>
+#include <QString>
+#include <QStringList>
+
+/**
+* Values of one occurrence as shown by the delegate and used by the filter
+* The dates are those of the occurrence, not of the recurring incidence.
+*/
+struct IncidenceRecord
+{
+    IncidenceRecord()
+        : itemType(0), itemId(-1), revision(0), collectionId(-1),
+          status(0), percent(0), yearsSince(0),
+          recurs(false), isBirthday(false), isAnniversary(false), completed(false),
+          hasStartDate(false), hasDueDate(false), inProgress(false), isOverdue(false)
+    {
+    }
+
+    int itemType;
+    Akonadi::Item::Id itemId;
+    int revision;
+    Akonadi::Entity::Id collectionId;
+
+    QString resource;
+    QString collectionName;
+    QString uid;
+    QString remoteId;
+    QString summary;
+    QString description;
+    QString location;
+    QString mainCategory;
+    QStringList categories;
+    QString contactName;
+
+    QDateTime startDate;
+    QDateTime endDate;
+    QDateTime dueDate;
+    QDateTime completedDate;
+
+    int status;
+    int percent;
+    int yearsSince;
+
+    bool recurs;
+    bool isBirthday;
+    bool isAnniversary;
+    bool completed;
+    bool hasStartDate;
+    bool hasDueDate;
+    bool inProgress;
+    bool isOverdue;
+};
+
+Q_DECLARE_METATYPE(IncidenceRecord)
+
+/**
+* Immutable record of an incidence, shared by all of its occurrences
+* The interned ids are set by EventModel before the occurrences are added.
+*/
+class IncidenceData : public QSharedData
+{
+public:
+    explicit IncidenceData(const IncidenceRecord &r) : record(r), collectionIndex(-1) {}
+
+    const IncidenceRecord record;
+    int collectionIndex;
+    FilterMask categoryMask;
+};
+
+typedef QExplicitlySharedDataPointer<IncidenceData> IncidencePtr;
+
+#endif
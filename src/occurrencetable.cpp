@@ -0,0 +1,224 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *   Copyright (C) 2012 by gerdfleischer <gerdfleischer@web.de>
+ */
+
+#include "occurrencetable.h"
+#include "eventmodel.h"
+
+static const int SecsPerDay = 86400;
+
+OccurrenceTable::OccurrenceTable()
+{
+}
+
+qint64 OccurrenceTable::sortKey(const QDateTime &dtTime)
+{
+    if (!dtTime.isValid())
+        return 0;
+
+    return qint64(dtTime.date().toJulianDay()) * SecsPerDay + QTime(0, 0).secsTo(dtTime.time());
+}
+
+QDateTime OccurrenceTable::dateTime(const QVector<int> &days, const QVector<int> &secs, int slot) const
+{
+    const int day = days.at(slot);
+    if (day == 0)
+        return QDateTime();
+
+    return QDateTime(QDate::fromJulianDay(day), QTime(0, 0).addSecs(secs.at(slot)));
+}
+
+void OccurrenceTable::setDateTime(QVector<int> &days, QVector<int> &secs, int slot, const QDateTime &dtTime)
+{
+    if (dtTime.isValid()) {
+        days[slot] = dtTime.date().toJulianDay();
+        secs[slot] = QTime(0, 0).secsTo(dtTime.time());
+    } else {
+        days[slot] = 0;
+        secs[slot] = 0;
+    }
+}
+
+int OccurrenceTable::append(const IncidencePtr &incidence, int type, const QDateTime &date, const QDateTime &end)
+{
+    int slot;
+    if (!m_freeSlots.isEmpty()) {
+        slot = m_freeSlots.last();
+        m_freeSlots.pop_back();
+    } else {
+        slot = m_type.size();
+        const int size = slot + 1;
+        m_type.resize(size);
+        m_day.resize(size);
+        m_secs.resize(size);
+        m_endDay.resize(size);
+        m_endSecs.resize(size);
+        m_incidence.resize(size);
+        m_state.resize(size);
+    }
+
+    m_type[slot] = type;
+    setDateTime(m_day, m_secs, slot, date);
+    setDateTime(m_endDay, m_endSecs, slot, end);
+    m_incidence[slot] = incidence;
+    m_state[slot] = NormalState;
+
+    return slot;
+}
+
+void OccurrenceTable::remove(int slot)
+{
+    m_incidence[slot].reset();
+    m_freeSlots.append(slot);
+}
+
+void OccurrenceTable::replace(int slot, int other)
+{
+    m_type[slot] = m_type.at(other);
+    m_day[slot] = m_day.at(other);
+    m_secs[slot] = m_secs.at(other);
+    m_endDay[slot] = m_endDay.at(other);
+    m_endSecs[slot] = m_endSecs.at(other);
+    m_incidence[slot] = m_incidence.at(other);
+    m_state[slot] = m_state.at(other);
+}
+
+void OccurrenceTable::clear()
+{
+    m_type.clear();
+    m_day.clear();
+    m_secs.clear();
+    m_endDay.clear();
+    m_endSecs.clear();
+    m_incidence.clear();
+    m_state.clear();
+    m_freeSlots.clear();
+}
+
+int OccurrenceTable::type(int slot) const
+{
+    return m_type.at(slot);
+}
+
+qint64 OccurrenceTable::sortKey(int slot) const
+{
+    return qint64(m_day.at(slot)) * SecsPerDay + m_secs.at(slot);
+}
+
+QDateTime OccurrenceTable::sortDateTime(int slot) const
+{
+    return dateTime(m_day, m_secs, slot);
+}
+
+void OccurrenceTable::setSortDateTime(int slot, const QDateTime &dtTime)
+{
+    setDateTime(m_day, m_secs, slot, dtTime);
+}
+
+int OccurrenceTable::day(int slot) const
+{
+    return m_day.at(slot);
+}
+
+int OccurrenceTable::endDay(int slot) const
+{
+    return m_endDay.at(slot);
+}
+
+Akonadi::Item::Id OccurrenceTable::itemId(int slot) const
+{
+    return m_incidence.at(slot)->record.itemId;
+}
+
+Akonadi::Entity::Id OccurrenceTable::collectionId(int slot) const
+{
+    return m_incidence.at(slot)->record.collectionId;
+}
+
+QString OccurrenceTable::uid(int slot) const
+{
+    return m_incidence.at(slot)->record.uid;
+}
+
+int OccurrenceTable::revision(int slot) const
+{
+    return m_incidence.at(slot)->record.revision;
+}
+
+QDate OccurrenceTable::endDate(int slot) const
+{
+    const int jd = m_endDay.at(slot);
+    return jd ? QDate::fromJulianDay(jd) : QDate();
+}
+
+bool OccurrenceTable::isCompleted(int slot) const
+{
+    return m_incidence.at(slot)->record.completed;
+}
+
+QString OccurrenceTable::mainCategory(int slot) const
+{
+    return m_incidence.at(slot)->record.mainCategory;
+}
+
+const QStringList &OccurrenceTable::categories(int slot) const
+{
+    return m_incidence.at(slot)->record.categories;
+}
+
+int OccurrenceTable::collectionIndex(int slot) const
+{
+    return m_incidence.at(slot)->collectionIndex;
+}
+
+const FilterMask &OccurrenceTable::categoryMask(int slot) const
+{
+    return m_incidence.at(slot)->categoryMask;
+}
+
+IncidenceRecord OccurrenceTable::record(int slot) const
+{
+    IncidenceRecord record = m_incidence.at(slot)->record;
+    const int type = m_type.at(slot);
+    record.itemType = type;
+
+    if (type == EventModel::TodoItem) {
+        record.dueDate = dateTime(m_day, m_secs, slot);
+    } else {
+        const QDate incidenceStart = record.startDate.date();
+        record.startDate = dateTime(m_day, m_secs, slot);
+        record.endDate = dateTime(m_endDay, m_endSecs, slot);
+        if (type == EventModel::BirthdayItem || type == EventModel::AnniversaryItem)
+            record.yearsSince = record.startDate.date().year() - incidenceStart.year();
+    }
+
+    return record;
+}
+
+IncidencePtr OccurrenceTable::incidence(int slot) const
+{
+    return m_incidence.at(slot);
+}
+
+OccurrenceTable::State OccurrenceTable::state(int slot) const
+{
+    return State(m_state.at(slot));
+}
+
+void OccurrenceTable::setState(int slot, State state)
+{
+    m_state[slot] = state;
+}
@@ -0,0 +1,83 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *   Copyright (C) 2012 by gerdfleischer <gerdfleischer@web.de>
+ */
+
+#ifndef OCCURRENCETABLE_H
+#define OCCURRENCETABLE_H
+
+#include "incidencerecord.h"
+
+// qt headers
+#include <QDateTime>
+#include <QStringList>
+#include <QVector>
+
+/**
+* Columnar storage for the occurrences of EventModel
+* Every occurrence lives in a slot and keeps its own dates and urgency state,
+* everything else is shared with the other occurrences of its incidence.
+* Removed slots are reused.
+*/
+class OccurrenceTable
+{
+public:
+    enum State { NormalState, UrgentState, PassedState };
+
+    OccurrenceTable();
+
+    int append(const IncidencePtr &incidence, int type, const QDateTime &date, const QDateTime &end);
+    void remove(int slot);
+    void replace(int slot, int other);
+    void clear();
+
+    int type(int slot) const;
+    qint64 sortKey(int slot) const;
+    QDateTime sortDateTime(int slot) const;
+    void setSortDateTime(int slot, const QDateTime &dtTime);
+    int day(int slot) const;
+    int endDay(int slot) const;
+    Akonadi::Item::Id itemId(int slot) const;
+    Akonadi::Entity::Id collectionId(int slot) const;
+    QString uid(int slot) const;
+    int revision(int slot) const;
+    QDate endDate(int slot) const;
+    bool isCompleted(int slot) const;
+    QString mainCategory(int slot) const;
+    const QStringList &categories(int slot) const;
+    int collectionIndex(int slot) const;
+    const FilterMask &categoryMask(int slot) const;
+    IncidenceRecord record(int slot) const;
+    IncidencePtr incidence(int slot) const;
+
+    State state(int slot) const;
+    void setState(int slot, State state);
+
+    static qint64 sortKey(const QDateTime &dtTime);
+
+private:
+    QDateTime dateTime(const QVector<int> &days, const QVector<int> &secs, int slot) const;
+    void setDateTime(QVector<int> &days, QVector<int> &secs, int slot, const QDateTime &dtTime);
+
+private:
+    QVector<quint8> m_type;
+    QVector<int> m_day, m_secs; // start of events, due date of todos
+    QVector<int> m_endDay, m_endSecs;
+    QVector<IncidencePtr> m_incidence;
+    QVector<quint8> m_state;
+    QVector<int> m_freeSlots;
+};
+
+#endif
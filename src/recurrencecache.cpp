@@ -0,0 +1,149 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *   Copyright (C) 2012 by gerdfleischer <gerdfleischer@web.de>
+ */
+
+#include "recurrencecache.h"
+
+// qt headers
+#include <QDataStream>
+#include <QFile>
+#include <QMutexLocker>
+
+// kde headers
+#include <KSaveFile>
+#include <KStandardDirs>
+
+#include <KDebug>
+
+static const quint32 CacheMagic = 0x45564c52; // "EVLR"
+static const quint32 CacheVersion = 1;
+
+RecurrenceCache::RecurrenceCache() : m_dirty(false)
+{
+}
+
+QString RecurrenceCache::fileName() const
+{
+    return KStandardDirs::locateLocal("data", "plasma-applet-events/recurrences.cache");
+}
+
+void RecurrenceCache::load()
+{
+    QMutexLocker locker(&m_mutex);
+    m_entries.clear();
+    m_dirty = false;
+
+    QFile file(fileName());
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    quint32 magic, version, count;
+    stream >> magic >> version >> count;
+    if (magic != CacheMagic || version != CacheVersion) {
+        kDebug() << "Ignoring recurrence cache with unknown format";
+        return;
+    }
+
+    const QDate today = QDate::currentDate();
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        qint64 id;
+        qint32 revision;
+        Entry entry;
+        stream >> id >> revision >> entry.from >> entry.coveredUntil >> entry.dates;
+        entry.revision = revision;
+
+        // entries that end before today can never be used again
+        if (entry.coveredUntil >= today)
+            m_entries.insert(id, entry);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        kDebug() << "Recurrence cache is corrupt, dropping it";
+        m_entries.clear();
+    }
+}
+
+void RecurrenceCache::save()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_dirty)
+        return;
+
+    KSaveFile file(fileName());
+    if (!file.open(QIODevice::WriteOnly)) {
+        kDebug() << "Could not write recurrence cache" << file.errorString();
+        return;
+    }
+
+    const QDate today = QDate::currentDate();
+    QList<Akonadi::Item::Id> ids;
+    QHash<Akonadi::Item::Id, Entry>::const_iterator it;
+    for (it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        if (it.value().coveredUntil >= today)
+            ids << it.key();
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << CacheMagic << CacheVersion << quint32(ids.count());
+    foreach (Akonadi::Item::Id id, ids) {
+        const Entry &entry = m_entries[id];
+        stream << qint64(id) << qint32(entry.revision) << entry.from << entry.coveredUntil << entry.dates;
+    }
+
+    if (file.finalize())
+        m_dirty = false;
+}
+
+bool RecurrenceCache::lookup(Akonadi::Item::Id id, int revision, const QDate &from, const QDate &to, int limit, QList<QDateTime> *dates) const
+{
+    QMutexLocker locker(&m_mutex);
+    QHash<Akonadi::Item::Id, Entry>::const_iterator it = m_entries.constFind(id);
+    if (it == m_entries.constEnd())
+        return false;
+
+    const Entry &entry = it.value();
+    if (entry.revision != revision || entry.from > from)
+        return false;
+
+    dates->clear();
+    foreach (const QDateTime &dtTime, entry.dates) {
+        const QDate date = dtTime.date();
+        if (date < from)
+            continue;
+        if (date > to || (limit != 0 && dates->count() >= limit))
+            break;
+        dates->append(dtTime);
+    }
+
+    // the entry is only usable if it covers the whole window or enough occurrences
+    return entry.coveredUntil >= to || (limit != 0 && dates->count() >= limit);
+}
+
+void RecurrenceCache::insert(Akonadi::Item::Id id, int revision, const QDate &from, const QDate &coveredUntil, const QList<QDateTime> &dates)
+{
+    QMutexLocker locker(&m_mutex);
+    Entry entry;
+    entry.revision = revision;
+    entry.from = from;
+    entry.coveredUntil = coveredUntil;
+    entry.dates = dates;
+    m_entries.insert(id, entry);
+    m_dirty = true;
+}
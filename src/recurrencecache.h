@@ -0,0 +1,62 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *   Copyright (C) 2012 by gerdfleischer <gerdfleischer@web.de>
+ */
+
+#ifndef RECURRENCECACHE_H
+#define RECURRENCECACHE_H
+
+#include <akonadi/item.h>
+
+// qt headers
+#include <QDate>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+
+/**
+* Disk cache for expanded recurrences
+* An entry is valid for one revision of an item and covers the
+* occurrences from its start date up to its covered date.
+* Lookups and inserts may come from the decoding threads.
+*/
+class RecurrenceCache
+{
+public:
+    RecurrenceCache();
+
+    void load();
+    void save();
+
+    bool lookup(Akonadi::Item::Id id, int revision, const QDate &from, const QDate &to, int limit, QList<QDateTime> *dates) const;
+    void insert(Akonadi::Item::Id id, int revision, const QDate &from, const QDate &coveredUntil, const QList<QDateTime> &dates);
+
+private:
+    struct Entry {
+        int revision;
+        QDate from;
+        QDate coveredUntil;
+        QList<QDateTime> dates;
+    };
+
+    QString fileName() const;
+
+    QHash<Akonadi::Item::Id, Entry> m_entries;
+    bool m_dirty;
+    mutable QMutex m_mutex;
+};
+
+#endif